@@ -7,10 +7,27 @@ namespace Card_Comm {
 const uint8_t READ_DATA_MAX_LENGTH = 2;
 
 enum {RT_LINE=0, RT_TRUNK}; /* Resource types */
+enum {CP_NORMAL=0, CP_URGENT}; /* Command priorities, use CP_URGENT for signalling-critical commands */
 
 
 typedef void (*Event_Handler)(uint32_t event_type, uint32_t resource );
 
+/* Outstanding event read for one card */
+typedef struct Card_Context {
+	uint8_t resource_type; /* RT_LINE or RT_TRUNK */
+	uint8_t read_data[READ_DATA_MAX_LENGTH];
+	Event_Handler handler;
+	uint32_t atten_time;
+} Card_Context_Type;
+
+/* Attention to event handler latency statistics, times are in milliseconds */
+typedef struct Atten_Stats {
+	uint32_t events;
+	uint32_t failures;
+	uint32_t total_latency;
+	uint32_t max_latency;
+} Atten_Stats_Type;
+
 
 
 class Card_Comm {
@@ -19,14 +36,17 @@ public:
 	void _event_callback(uint32_t type, uint32_t status, uint32_t trans_id);
 	void init(void);
 	bool queue_get_event_request(uint32_t card, Event_Handler handler = NULL);
-	bool send_command(uint32_t resource_type, uint32_t resource, uint32_t command,  uint32_t parameter = 0);
+	uint32_t queue_get_event_requests(uint32_t card_mask, Event_Handler line_handler, Event_Handler trunk_handler);
+	void get_atten_stats(uint32_t card, Atten_Stats_Type &stats);
+	void clear_atten_stats(void);
+	bool send_command(uint32_t resource_type, uint32_t resource, uint32_t command,  uint32_t parameter = 0, uint32_t priority = CP_NORMAL);
 
 
 protected:
 	osMutexId_t _lock;
-	Event_Handler _event_handler;
-	uint8_t _pending_bits;
-	uint8_t _i2c_read_data[Atten::MAX_NUM_CARDS][READ_DATA_MAX_LENGTH];
+	uint32_t _pending_bits; /* Only modified with atomic operations */
+	Card_Context_Type _card_contexts[Atten::MAX_NUM_CARDS];
+	Atten_Stats_Type _atten_stats[Atten::MAX_NUM_CARDS];
 
 
 };
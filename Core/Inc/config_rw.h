@@ -1,6 +1,7 @@
 #pragma once
 #include "top.h"
 #include "pool_alloc.h"
+#include "util.h"
 
 namespace Config_RW {
 
@@ -11,6 +12,11 @@ const uint32_t MAX_SECTION = 23;
 const uint32_t MAX_SECTION_BLOCKS = 64;
 const uint32_t MAX_NODE_BLOCKS = 256;
 const uint32_t LINE_BUFFER_SIZE = 127;
+const uint32_t NUM_CONFIG_GENERATIONS = 2;
+const uint32_t MAX_INDEX_ENTRIES = 16;
+const uint32_t MAX_CACHED_PATH = 31;
+const uint32_t PATH_CACHE_ENTRIES = 16;
+const uint32_t MAX_AUDIO_ASSETS = 8;
 
 
 enum {VT_OBJECT, VT_STRING, VT_NUMBER, VT_BOOLEAN};
@@ -39,12 +45,58 @@ struct Config_Section {
 	struct Config_Section *prev;
 	struct Config_Node *head;
 	struct Config_Node *tail;
+	struct Config_Node **index; /* Numeric key index, NULL if the section isn't indexed */
+	uint32_t index_size;
+};
+
+/* Resolved path cache entry */
+struct Config_Path_Cache_Entry {
+	char starting_section[MAX_SECTION + 1];
+	char path[MAX_CACHED_PATH + 1];
+	uint32_t last_used;
+	struct Config_Node *node;
 };
 
 typedef struct Config_Node Config_Node_Type;
 typedef struct Config_Section Config_Section_Type;
+typedef struct Config_Path_Cache_Entry Config_Path_Cache_Entry_Type;
 typedef bool (*Traverse_Nodes_Callback_Type)(const char *section, const char *key, const char *value, uint32_t line_num, void *data);
 
+/*
+ * A configuration generation holds one complete parsed copy of the configuration tree.
+ *
+ * New calls reference the current generation. A reload parses into the spare generation,
+ * and switches new calls over to it once it validates.
+ */
+
+struct Config_Generation {
+	uint32_t number;
+	uint32_t ref_count;
+	Config_Section_Type *section_head;
+	Config_Section_Type *section_tail;
+	uint32_t index_entries_used;
+	Config_Node_Type *index_memory[MAX_INDEX_ENTRIES];
+	uint32_t cache_clock;
+	uint32_t cache_hits;
+	uint32_t cache_misses;
+	Config_Path_Cache_Entry_Type path_cache[PATH_CACHE_ENTRIES];
+	uint8_t section_memory_pool[sizeof(Config_Section_Type) * MAX_SECTION_BLOCKS];
+	uint8_t node_memory_pool[sizeof(Config_Node_Type) * MAX_NODE_BLOCKS];
+	Pool_Alloc::Pool_Alloc section_pool;
+	Pool_Alloc::Pool_Alloc node_pool;
+};
+
+typedef struct Config_Generation Config_Generation_Type;
+
+/* An audio sample which has a buffer reserved, and is loaded in the background */
+typedef struct Config_Audio_Asset {
+	const char *name;
+	char path[MAX_VALUE + 1];
+	uint8_t *buffer;
+	uint32_t size;
+	bool done; /* Load attempted */
+} Config_Audio_Asset_Type;
+
 
 class Config_RW {
 
@@ -54,37 +106,56 @@ protected:
 	Config_Node_Type *_add_node(char *key, char *value);
 	int32_t _read_line(void);
 	void _process_line(void);
-	Config_Node_Type *_find_node_by_path_helper(const char *section, char **substrings, uint32_t num_substrings, uint32_t index);
+	bool _load(Config_Generation_Type *gen);
+	bool _validate(Config_Generation_Type *gen);
+	void _log_usage(Config_Generation_Type *gen);
+	void _build_numeric_index(Config_Generation_Type *gen, const char *section_name, uint32_t max_keys);
+	Config_Node_Type *_find_key(Config_Section_Type *section, const Util::Str_Span_Type &key);
+	Config_Node_Type *_resolve_path(Config_Generation_Type *gen, const char *starting_section, const char *path);
+	Config_Generation_Type *_tree(Config_Generation_Type *gen);
+	Config_Node_Type *_find_node_by_path_helper(Config_Generation_Type *gen, const char *section, const Util::Str_Span_Type *substrings, uint32_t num_substrings, uint32_t index);
+	static void _prefetch_task(void *args);
+	void _prefetch_worker(void);
 
 	char _line_buffer[LINE_BUFFER_SIZE + 1];
-	uint8_t _section_memory_pool[sizeof(Config_Section_Type) * MAX_SECTION_BLOCKS];
-	uint8_t _node_memory_pool[sizeof(Config_Node_Type) * MAX_NODE_BLOCKS];
 
 	int32_t _fd;
 	int32_t _file_status;
 	uint32_t _line_number;
+	uint32_t _error_count;
+	bool _errors_are_fatal;
+	bool _reload_in_progress;
 
-	Config_Section_Type *_section_head;
-	Config_Section_Type *_section_tail;
+	Config_Generation_Type _generations[NUM_CONFIG_GENERATIONS];
+	Config_Generation_Type *_current;
+	Config_Generation_Type *_loading;
+	uint32_t _num_audio_assets;
+	bool _prefetch_running;
+	Config_Audio_Asset_Type _audio_assets[MAX_AUDIO_ASSETS];
 
 	osMutexId_t _lock;
-	Pool_Alloc::Pool_Alloc _section_pool;
-	Pool_Alloc::Pool_Alloc _node_pool;
 
 
 public:
 	void init(void);
+	bool reload(bool check_only = false);
+	Config_Generation_Type *acquire(void);
+	void release(Config_Generation_Type *gen);
+	uint32_t get_generation_number(void);
 	const char *get_value(const char *section, const char *key, uint32_t &line_number);
 	uint32_t get_arg_count(const char *value);
 	int32_t get_arguments(const char *value, const char *format, ...);
-	bool traverse_nodes(const char *section, Traverse_Nodes_Callback_Type callback=NULL, void *data=NULL);
+	bool traverse_nodes(const char *section, Traverse_Nodes_Callback_Type callback=NULL, void *data=NULL, Config_Generation_Type *gen=NULL);
 	void syntax_error(uint32_t line_num, const char *message = NULL);
-	bool stat_and_load_audio_sample(const char *sample_name, const char *sample_path);
+	bool stat_and_register_audio_sample(const char *sample_name, const char *sample_path);
+	void start_prefetch(void);
 	const char *get_progress_tone_buffer_name(uint32_t pt_type);
-	Config_Section_Type *find_section(const char *section_name);
+	Config_Section_Type *find_section(const char *section_name, Config_Generation_Type *gen=NULL);
 	Config_Node_Type *find_node(const char *node_name, Config_Node_Type *node_head);
 	Config_Node_Type *find_node(unsigned num, Config_Node_Type *node_head);
-	Config_Node_Type *find_node_by_path(const char *starting_section, const char *path);
+	Config_Node_Type *find_node(unsigned num, Config_Section_Type *section);
+	Config_Node_Type *find_node_by_path(const char *starting_section, const char *path, Config_Generation_Type *gen=NULL);
+	void get_path_cache_stats(uint32_t &hits, uint32_t &misses, uint32_t &entries_used);
 
 
 };
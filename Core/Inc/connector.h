@@ -3,6 +3,7 @@
 #include "xps_logical.h"
 #include "pool_alloc.h"
 #include "config_rw.h"
+#include "resource_mgr.h"
 
 namespace Connector {
 const uint8_t MAX_DIALED_DIGITS = 15;
@@ -22,6 +23,8 @@ enum {PM_NOP=0,PM_SEIZE=1, PM_RELEASE=2, PM_ANSWERED=3, PM_CALLED_PARTY_HUNGUP=4
 	PM_TRUNK_READY_TO_CONNECT_CALLER=10};
 /* Peer message return values */
 enum {PMR_NOP=0, PMR_OK=1, PMR_BUSY=2, PMR_TRUNK_BUSY=3};
+/* Cut-through dialing states */
+enum {CT_NONE=0, CT_SEIZED, CT_READY, CT_FAILED};
 
 typedef void (*Conn_Handler_Type)(uint32_t event, uint32_t equip_type, uint32_t phys_line_trunk_num);
 
@@ -38,6 +41,7 @@ typedef struct Route_Info {
 	char *trunk_prefix;
 	Config_RW::Config_Node_Type *rt_head;
 	Config_RW::Config_Section_Type *dest_section;
+	Config_RW::Config_Generation_Type *config_gen;
 
 } Route_Info;
 
@@ -50,6 +54,8 @@ typedef struct Conn_Info {
 	uint8_t pending_state;
 	bool called_party_hangup;
 	bool junctor_seized;
+	bool resource_wait; /* Queued in the resource manager */
+	Resource_Mgr::Resource_Bundle resources; /* Reserved and not yet claimed */
 	int16_t tone_plant_descriptor;
 	int16_t mf_receiver_descriptor;
 	int16_t dtmf_receiver_descriptor;
@@ -61,21 +67,27 @@ typedef struct Conn_Info {
 	Route_Info route_info;
 	struct Conn_Info *peer;
 	osTimerId_t dial_timer;
+	uint8_t cut_through; /* Trunk seized while the caller is still dialing. CT_* */
 }Conn_Info;
 
 
 class Connector {
 protected:
 	uint32_t _test_against_route(const char *string_to_test, const char *route_table_entry);
+	void _set_trunk_destination(Route_Info *route_info, Config_RW::Config_Section_Type *tg_section, const char *dialed_digits);
+	uint32_t _seize_first_dest(Conn_Info *conn_info);
 	Pool_Alloc::Pool_Alloc _routing_pool;
 public:
 
 	void init(void);
 	void config();
 	void prepare(Conn_Info *conn_info, uint32_t source_equip_type, uint32_t source_phys_line_number);
+	void release_config(Conn_Info *conn_info);
 	uint32_t test(Conn_Info *conn_info, const char *dialed_digits);
 	uint32_t resolve(Conn_Info *conn_info);
 	uint32_t resolve_try_next_trunk(Conn_Info *conn_info);
+	bool seize_trunk_early(Conn_Info *conn_info, const char *dialed_digits);
+	void cancel_cut_through(Conn_Info *conn_info);
 
 	/* Peer-to-peer messaging */
 	/* For use by lines and trunks only in the event process. Does not respect locking */
@@ -96,6 +108,7 @@ public:
 	void release_mf_receiver(Conn_Info *linfo);
 	void release_dtmf_receiver(Conn_Info *linfo);
 	void release_tone_generator(Conn_Info *info);
+	int32_t seize_tone_generator(Conn_Info *info);
 	bool seize_and_connect_tone_generator(Conn_Info *info, bool orig_term=true);
 	void send_ringing(Conn_Info *info);
 	void send_busy(Conn_Info *info);
@@ -103,6 +116,12 @@ public:
 	void release_called_party(Conn_Info *info);
 	const char *get_digits_recognized_buffer_name(void);
 	void send_dial_tone(int32_t descriptor);
+	void init_resources(Conn_Info *info);
+	bool reserve_resources(Conn_Info *info, uint32_t type_mask, uint32_t priority);
+	int32_t claim_resource(Conn_Info *info, uint32_t type);
+	void release_resources(Conn_Info *info);
+	void abandon_resources(Conn_Info *info);
+	void resources_granted(Conn_Info *info);
 
 
 };
@@ -20,6 +20,7 @@ const uint8_t MAX_ARGS = 8;
 enum {AT_END = 0, AT_UINT, AT_FL};
 enum {CEC_NONE = 0, CEC_UNK_CMD, CEC_INC_NUM_PARAMS, CEC_PARAM_ERROR, CEC_PARAM_OUT_OF_RANGE, CEC_TABLE_ERROR,
 	CEC_RESOURCE_IN_USE, CEC_NO_RESOURCE, CEC_RESOURCE_ALLOCATED, CEC_TRUNK_NOT_PRESENT_OR_IN_USE,
+	CEC_CONFIG_NOT_RELOADED, CEC_CONFIG_ERRORS,
 
 	CEC_UNKNOWN};
 
@@ -8,6 +8,7 @@ const uint32_t MAX_NUM_CARDS = 7;
 class Atten {
 public:
 	bool get_state(uint32_t card);
+	uint32_t get_snapshot(void);
 };
 
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "top.h"
+#include "resource_mgr.h"
 
 
 
@@ -16,9 +17,9 @@ class Dtmf {
 public:
 	void init(void);
 	void poll();
-	int32_t seize(Dtmf_Callback callback, uint32_t parameter = 0, int32_t receiver=-1);
+	int32_t seize(Dtmf_Callback callback, uint32_t parameter = 0, int32_t receiver=-1, void *owner=NULL);
 	void release(int32_t descriptor);
-	uint32_t get_siezed_receivers(void) { return this->_siezed_receivers;};
+	uint32_t get_siezed_receivers(void) { return Resource_mgr.get_busy_bits(Resource_Mgr::RT_DTMF_RECEIVER);};
 
 protected:
 	/* Low level hardware interface functions */
@@ -28,7 +29,6 @@ protected:
 
 
 	osMutexId_t _lock;
-	uint32_t _siezed_receivers;
 	uint32_t _parameter[NUM_DTMF_RECEIVERS];
 	uint8_t _state[NUM_DTMF_RECEIVERS];
 	char _digit[NUM_DTMF_RECEIVERS];
@@ -3,19 +3,31 @@
 
 namespace Xps {
 
-const uint8_t NUM_CPS_CHIPS = 2;
+const uint8_t MAX_CPS_CHIPS = 3; /* One per chip select line */
 const uint8_t MAX_ROWS = 16;
 const uint8_t MAX_COLUMNS = 8;
 
+/* One crosspoint change in a batch */
+typedef struct Xps_Op {
+	uint8_t x;
+	uint8_t y;
+	uint8_t cs_number;
+	bool state;
+} Xps_Op;
+
 class Xps {
 public:
 	void init(void);
 	void clear(void);
 	void modify(uint32_t x, uint32_t y, uint32_t cs_number, bool state);
+	void modify_batch(const Xps_Op *ops, uint32_t count);
 
 protected:
-	void _set_cs_state(uint32_t cs_number, bool state);
+	void _write_op(const Xps_Op *op);
 	osMutexId_t _lock;
+	GPIO_TypeDef *_addr_port;
+	uint32_t _x_bsrr[MAX_ROWS];
+	uint32_t _y_bsrr[MAX_COLUMNS];
 };
 
 
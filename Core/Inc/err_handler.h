@@ -50,6 +50,7 @@ enum {
 	EH_INVC=39, /* Invalid Command */
 	EH_USF=40, /* Unsupported feature */
 	EH_NORC=41, /* No resource */
+	EH_EFC=42, /* Could not create event flags */
 
 	EH_NUM_ERROR_CODES
 };
@@ -3,13 +3,20 @@
 
 namespace Event {
 
+const uint32_t TICK_TIME = 10; /* Milliseconds between timed polls */
+
+/* Event flags */
+enum {EF_WORK_POSTED = 0x00000001};
+
 class Event {
 public:
 	void init(void);
 	void worker(void *args);
+	void wake(void);
 
 protected:
 	osMutexId_t _lock;
+	osEventFlagsId_t _event_flags;
 
 };
 
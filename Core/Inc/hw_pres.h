@@ -3,6 +3,7 @@
 #include "top.h"
 #include "sub_line.h"
 #include "trunk.h"
+#include "i2c_engine.h"
 
 namespace Sub_Line {
 
@@ -12,6 +13,10 @@ namespace Sub_Line {
 
 namespace HW_Pres {
 
+const uint32_t CARD_STARTUP_TIME = 1000; /* Milliseconds after power up before the cards can be probed */
+const uint32_t PROBE_TIMEOUT = 500; /* Milliseconds to wait for all probe transactions to complete */
+const uint8_t NUM_CARD_POSITIONS = Sub_Line::MAX_DUAL_LINE_CARDS + Trunk::MAX_TRUNK_CARDS;
+
 
 class HW_Pres {
 protected:
@@ -19,8 +24,10 @@ protected:
 	uint8_t _num_installed_trunk_cards;
 	uint8_t _installed_dual_line_cards;
 	uint8_t _installed_trunk_cards;
-	uint8_t _response_status;
-	bool _response_received;
+	uint8_t _response_status[NUM_CARD_POSITIONS];
+	uint8_t _probe_data[NUM_CARD_POSITIONS][2][2];
+	I2C_Engine::I2C_Chain_Step _probe_steps[NUM_CARD_POSITIONS][2];
+	osEventFlagsId_t _event_flags;
 
 public:
 	void probe(void);
@@ -4,16 +4,22 @@
 namespace I2C_Engine {
 
 enum {I2CS_IDLE=0, I2CS_EXP_WRITE_WAIT, I2CS_DO_REGISTER_RW, I2CS_READ_REG, I2CS_READ_REG_WAIT_REG_XMIT, I2CS_READ_REG_WAIT_RCV, I2CS_WRITE_REG,
-	I2CS_WRITE_REG_WAIT_REG_XMIT, I2CS_WRITE_REG_WAIT_DATA_XMIT, I2CS_FINISH};
-
-
-enum {I2CT_READ_REG8=0, I2CT_WRITE_REG8, I2CT_MAX_I2C_TYPES};
-enum {I2CEC_OK=0, I2CEC_NO_DEVICE, I2CEC_TRANS_FAILED, I2CEC_DMA_FAILED};
+	I2CS_WRITE_REG_WAIT_REG_XMIT, I2CS_WRITE_REG_WAIT_DATA_XMIT, I2CS_FINISH, I2CS_READ_REG_RS};
+
+/* I2CT_READ_REG8_RS writes the register address and reads the data using a repeated start */
+/* I2CT_CHAIN is only used by queue_chain() and is passed to the callback when the whole chain completes */
+enum {I2CT_READ_REG8=0, I2CT_WRITE_REG8, I2CT_READ_REG8_RS, I2CT_CHAIN, I2CT_MAX_I2C_TYPES};
+enum {I2CEC_OK=0, I2CEC_NO_DEVICE, I2CEC_TRANS_FAILED, I2CEC_DMA_FAILED, I2CEC_DEADLINE_MISSED};
+/* Transaction priorities. High priority transactions are always started before normal ones */
+enum {I2CP_HIGH=0, I2CP_NORMAL, NUM_I2C_PRIORITIES};
 enum {EVENT_FLAG_ISR = 1, EVENT_FLAG_WORK = 2};
 
-const uint8_t NUM_I2C_BUSSES = 1;
+const uint8_t NUM_I2C_BUSSES = 1; /* Bus 1 (hi2c4) needs DMA and interrupts enabled before this can be raised to 2 */
+const uint8_t I2C_ISR_QUEUE_DEPTH = 4;
+const uint8_t MAX_I2C_CHAIN_STEPS = 8;
 const uint8_t MAX_I2C_REG_DATA = 8;
 const uint8_t I2C_TRANSACTION_QUEUE_DEPTH = 16;
+const uint8_t I2C_HIGH_PRIORITY_QUEUE_DEPTH = 8;
 const uint8_t I2C_BUS_EXPANDER_ADDRESS = 0x70;
 
 /* I2C interrupt message queue codes */
@@ -32,11 +38,26 @@ typedef I2C_Queue_Message *pI2C_Queue_Message;
 
 typedef void (*I2C_Callback_Type)(uint32_t type, uint32_t status, uint32_t trans_id);
 
+/* One register read or write in a transaction chain */
+typedef struct I2C_Chain_Step {
+	uint8_t type; /* I2CT_READ_REG8, I2CT_WRITE_REG8, or I2CT_READ_REG8_RS */
+	uint8_t register_address;
+	uint8_t data_length;
+	uint8_t *data; /* Read or write buffer */
+} I2C_Chain_Step;
+
 typedef struct I2C_Transaction {
 	uint32_t hal_i2c_error_code;
 	uint32_t id;
 	uint8_t status;
 	uint8_t type;
+	uint8_t op; /* Register operation in progress */
+	uint8_t chain_length;
+	uint8_t chain_index;
+	uint8_t priority;
+	uint32_t queue_time; /* Tick count when queued */
+	uint32_t deadline; /* Milliseconds after queue_time to start by, 0 if none */
+	const I2C_Chain_Step *chain;
 	uint8_t bus_num;
 	int8_t expander_channel;
 	uint8_t device_address;
@@ -49,6 +70,30 @@ typedef struct I2C_Transaction {
 	uint8_t local_register_data[MAX_I2C_REG_DATA+1]; /* One more for write reg case to store register address */
 } I2C_Transaction;
 
+/* Queue statistics for one priority on one bus, times are in milliseconds */
+typedef struct I2C_Queue_Stats {
+	uint32_t queued;
+	uint32_t max_depth;
+	uint32_t total_wait;
+	uint32_t max_wait;
+	uint32_t deadline_misses;
+} I2C_Queue_Stats;
+
+/* State for one I2C bus. Each bus has its own worker thread and queues. */
+typedef struct I2C_Bus {
+	uint8_t bus_num;
+	uint8_t state;
+	bool i2c_msg_ready;
+	bool working;
+	int8_t selected_channel; /* Expander channel currently selected, -1 if unknown */
+	I2C_HandleTypeDef *handle;
+	osEventFlagsId_t event_flags;
+	osMessageQueueId_t queue_isr;
+	osMessageQueueId_t queue_transactions[NUM_I2C_PRIORITIES];
+	I2C_Queue_Stats stats[NUM_I2C_PRIORITIES];
+	I2C_Transaction trans;
+} I2C_Bus;
+
 
 
 class I2C_Engine {
@@ -56,20 +101,21 @@ public:
 	void init(void);
 	bool queue_transaction(uint32_t type, uint32_t bus,  int32_t expander_channel, uint32_t device_address,
 			uint32_t register_address, uint32_t data_length,
-			uint8_t *register_data, I2C_Callback_Type callback = NULL, uint32_t trans_id = 0);
+			uint8_t *register_data, I2C_Callback_Type callback = NULL, uint32_t trans_id = 0,
+			uint32_t priority = I2CP_NORMAL, uint32_t deadline = 0);
+	bool queue_chain(uint32_t bus, int32_t expander_channel, uint32_t device_address,
+			const I2C_Chain_Step *steps, uint32_t num_steps, I2C_Callback_Type callback = NULL, uint32_t trans_id = 0,
+			uint32_t priority = I2CP_NORMAL, uint32_t deadline = 0);
+	void get_queue_stats(uint32_t bus, uint32_t priority, I2C_Queue_Stats &stats);
 	void handler(I2C_HandleTypeDef *hi2c, uint32_t intr_type);
 	bool is_working(void);
 	void worker(void *args);
 
 protected:
 	bool _check_i2c_message(I2C_Queue_Message *m, uint8_t expected_message);
-	bool _i2c_msg_ready;
-	bool _working;
-	uint8_t _state;
-	I2C_Transaction trans;
-	osEventFlagsId_t _event_flags;
-	osMessageQueueId_t _queue_i2c_busses;
-	osMessageQueueId_t _queue_i2c_transactions;
+	bool _queue(I2C_Transaction *trans);
+	void _load_chain_step(I2C_Transaction *trans);
+	I2C_Bus _busses[NUM_I2C_BUSSES];
 };
 
 
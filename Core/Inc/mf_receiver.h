@@ -1,5 +1,6 @@
 #pragma once
 #include "top.h"
+#include "resource_mgr.h"
 
 #define MF_KP 0x0a
 #define MF_ST 0x0b
@@ -80,11 +81,11 @@ class MF_Decoder {
 public:
 void setup(); /* Called once before RTOS is running */
 void init(); /* Called once after RTOS is running */
-int32_t seize(Mf_Callback callback, void *parameter, int channel = -1, bool re_arm=false); /* Called to seize the MF receiver */
+int32_t seize(Mf_Callback callback, void *parameter, int channel = -1, bool re_arm=false, void *owner=NULL); /* Called to seize the MF receiver */
 void release(int32_t descriptor); /* Called to release the MF receiver */
 void handle_buffer(ADC_HandleTypeDef *hadc, uint8_t buffer_no); /* Called by the DMA engine when half full and full.*/
 void receiver_worker(void *args)  __attribute__((section(".xccmram")));
-uint32_t get_seized_receivers(void) {return this->_rx_in_use_bits;};
+uint32_t get_seized_receivers(void) {return Resource_mgr.get_busy_bits(Resource_Mgr::RT_MF_RECEIVER);};
 
 protected:
 
@@ -92,7 +93,6 @@ void _start_dma_transfers(uint32_t receiver_descriptor);
 void _stop_dma_transfers(uint32_t receiver_descriptor);
 osMessageQueueId_t _message_queue;
 osMutexId_t _lock;
-uint32_t _rx_in_use_bits;
 mfData _mf_data[NUM_MF_RECEIVERS];
 };
 
@@ -21,9 +21,11 @@ protected:
 	uint32_t _block_size;
 	void *_block_begin;
 	void *_alloc_ptr;
+	void _init_free_list(void);
 
 public:
 	void pool_init(void *memory_pool, uint32_t object_size, uint32_t num_objects);
+	void pool_reset(void);
 	void *allocate_object(void);
 	void deallocate_object(void *object);
 	uint32_t get_num_allocated_objects(void);
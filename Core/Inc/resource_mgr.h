@@ -0,0 +1,97 @@
+#pragma once
+#include "top.h"
+
+namespace Resource_Mgr {
+
+/* Resource types */
+enum {RT_JUNCTOR=0, RT_TONE_CHANNEL, RT_DTMF_RECEIVER, RT_MF_RECEIVER, NUM_RESOURCE_TYPES};
+
+/* Resource type masks, used to reserve several types at once */
+enum {RM_JUNCTOR=(1 << RT_JUNCTOR), RM_TONE_CHANNEL=(1 << RT_TONE_CHANNEL), RM_DTMF_RECEIVER=(1 << RT_DTMF_RECEIVER),
+	RM_MF_RECEIVER=(1 << RT_MF_RECEIVER)};
+
+/* Reservation priorities */
+enum {RP_LOW=0, RP_NORMAL, RP_HIGH};
+
+const uint32_t MAX_RESOURCES_PER_TYPE = 32;
+const uint32_t MAX_WAITERS = 32;
+
+/* One resource index per type. -1 if the type was not reserved */
+typedef struct Resource_Bundle {
+	int8_t index[NUM_RESOURCE_TYPES];
+} Resource_Bundle;
+
+/*
+ * Called when the resources a waiter asked for have all been reserved for it.
+ * The waiter collects the bundle by calling reserve() again, then claims each one by
+ * seizing it with the index in the bundle, passing its data as the owner.
+ */
+
+typedef void (*Resource_Grant_Callback)(void *data);
+
+typedef struct Resource_Waiter {
+	Resource_Grant_Callback callback;
+	void *data;
+	uint32_t start_time;
+	uint8_t type_mask;
+	uint8_t priority;
+	bool granted; /* Bundle reserved, waiting to be collected */
+	Resource_Bundle bundle;
+} Resource_Waiter;
+
+typedef struct Resource_Stats {
+	uint32_t grants; /* Resources handed out */
+	uint32_t failures; /* Requests made when none were free */
+	uint32_t waits; /* Requests queued */
+	uint32_t handoffs; /* Resources reserved for a queued waiter */
+	uint32_t in_use;
+	uint32_t peak_in_use;
+	uint32_t waiting; /* Queued waiters not yet granted. While non zero, allocate() only hands out reservations */
+	uint32_t peak_waiting;
+	uint32_t total_wait_time; /* mS */
+	uint32_t max_wait_time; /* mS */
+} Resource_Stats;
+
+typedef struct Resource_Pool {
+	uint32_t busy_bits; /* Changed with atomic compare and swap */
+	uint32_t reserved_bits; /* Busy, and reserved for a caller which hasn't claimed it yet */
+	void *owners[MAX_RESOURCES_PER_TYPE]; /* Who each reserved resource is reserved for */
+	uint32_t mask;
+	Resource_Stats stats;
+} Resource_Pool;
+
+
+class Resource_Mgr {
+public:
+	void init(void);
+	int32_t allocate(uint32_t type, int32_t requested = -1, void *owner = NULL);
+	bool reserve(uint32_t type_mask, Resource_Bundle &bundle, Resource_Grant_Callback callback, void *data, uint32_t priority = RP_NORMAL);
+	void release(uint32_t type, int32_t index);
+	void release_reserved(Resource_Bundle &bundle);
+	void release_owned(void *owner);
+	bool cancel_wait(void *data);
+	uint32_t get_busy_bits(uint32_t type);
+	void get_stats(uint32_t type, Resource_Stats &stats);
+	void clear_stats(uint32_t type);
+
+protected:
+	Resource_Pool *_get_pool(uint32_t type);
+	int32_t _take(Resource_Pool *pool, int32_t requested);
+	void _free(Resource_Pool *pool, int32_t index);
+	void _count_grant(Resource_Pool *pool);
+	bool _take_bundle(uint32_t type_mask, Resource_Bundle &bundle, void *owner);
+	void _count_waiting(uint32_t type_mask, bool add);
+	void _remove_waiter(uint32_t i);
+	bool _grant_next(Resource_Waiter &waiter);
+	void _serve_waiters(void);
+
+	osMutexId_t _lock;
+	Resource_Pool _pools[NUM_RESOURCE_TYPES];
+	/* Waiters, highest priority first, then oldest first */
+	Resource_Waiter _waiters[MAX_WAITERS];
+	uint32_t _waiter_count;
+};
+
+} /* End namespace Resource_Mgr */
+
+extern Resource_Mgr::Resource_Mgr Resource_mgr;
@@ -7,6 +7,8 @@ namespace Sub_Line {
 const uint32_t DTMF_DIGIT_DIAL_TIME = 30000; /* 30 seconds */
 const uint32_t CONGESTION_SEND_TIME = 30000; /* 30 Seconds */
 const uint32_t DIGITS_RECOGNIZED_DELAY = 125; /* 1/8 second */
+const uint32_t MAX_SERVICE_STEPS = 8; /* Max state transitions per line per pass */
+const uint32_t MAX_SERVICE_PASSES = 4; /* Max passes over lines with pending events */
 
 const uint8_t MAX_DUAL_LINE_CARDS = 4;
 const uint8_t LINE_CARD_I2C_ADDRESS = 0x30;
@@ -20,10 +22,10 @@ enum {EV_NONE=0, EV_READY=1, EV_REQUEST_OR=2, EV_DIALED_DIGIT=2, EV_HOOKFLASH=3,
 
 
 /* States */
-enum {LS_IDLE=0, LS_SEIZE_JUNCTOR=1, LS_SEIZE_TG=2, LS_SEIZE_DTMFR=3, LS_WAIT_FIRST_DIGIT=4,
+enum {LS_IDLE=0, LS_SEIZE_JUNCTOR=1, LS_WAIT_FIRST_DIGIT=4,
 	LS_WAIT_ROUTE=5, LS_DIAL_TIMEOUT=6, LS_SEND_BUSY=7, LS_SEND_CONGESTION=8, LS_CONGESTION_DISCONNECT=9, LS_WAIT_ANSWER=10,
 	LS_CALLED_PARTY_ANSWERED=11, LS_CALLED_PARTY_HUNGUP=12, LS_WAIT_END_CALL=13,
-	LS_ORIG_DISCONNECT=14, LS_ORIG_DISCONNECT_B=15, LS_ORIG_DISCONNECT_C=16, LS_ORIG_DISCONNECT_D=17, LS_ORIG_DISCONNECT_E=18,
+	LS_ORIG_DISCONNECT=14, LS_ORIG_DISCONNECT_C=16, LS_ORIG_DISCONNECT_D=17, LS_ORIG_DISCONNECT_E=18,
 	LS_ORIG_DISCONNECT_F=19, LS_FAR_END_DISCONNECT=20, LS_FAR_END_DISCONNECT_B=21, LS_END_CALL=22,
 	LS_WAIT_HANGUP=23, LS_RING=24, LS_RINGING=25, LS_ANSWER=26, LS_ANSWERED=27, LS_SEIZE_TRUNK=28,
 	LS_WAIT_TRUNK_RESPONSE=29, LS_TRUNK_OUTGOING_RELEASE=30, LS_TRUNK_SEND_ADDR_INFO = 31, LS_TRUNK_WAIT_ADDR_SENT=32,
@@ -35,8 +37,10 @@ class Sub_Line {
 protected:
 	osMutexId_t _lock;
 	osEventFlagsId_t _event_flags;
-	uint8_t _line_to_service;
+	uint32_t _pending_lines; /* Changed with atomic operations */
 	Connector::Conn_Info _conn_info[MAX_DUAL_LINE_CARDS * 2];
+	void _post_event(uint32_t line);
+	void _service(uint8_t line);
 
 
 public:
@@ -45,7 +49,8 @@ public:
 	void event_handler(uint32_t event_type, uint32_t resource);
 	void set_power_state(uint32_t line, bool state);
 	void _digit_receiver_callback(int32_t descriptor, char digit, uint32_t parameter);
-	void poll(void);
+	void poll(bool tick);
+	void wake(uint32_t line);
 	uint32_t peer_message_handler(Connector::Conn_Info *conn_info, uint32_t phys_line_trunk_number, uint32_t message);
 	void _dial_timer_callback(void *arg);
 	void _tone_complete_callback(uint32_t channel_number, void *data);
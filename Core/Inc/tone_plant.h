@@ -1,5 +1,6 @@
 #pragma once
 #include "top.h"
+#include "resource_mgr.h"
 
 
 namespace Tone_Plant {
@@ -76,6 +77,7 @@ typedef struct audioBufferEntry {
 	char name[AUDIO_BUFFER_ENTRY_NAME_SIZE];
 	uint8_t *buffer_start;
 	uint32_t buffer_size;
+	bool ready; /* Set once the audio data has been loaded */
 } audioBufferEntry;
 
 /* Data passed in message queue from interrupt */
@@ -274,13 +276,14 @@ public:
 	bool send_buffer_loop_ulaw(int32_t descriptor, const char *buffer_name, float level = 0.0);
 	void send_single_tone(uint32_t descriptor, float freq, float level);
 	void stop(int32_t descriptor);
-	int32_t channel_seize(int32_t requested_channel = -1);
+	int32_t channel_seize(int32_t requested_channel = -1, void *owner = NULL);
 	void channel_release(int32_t descriptor);
 	uint8_t *allocate_audio_buffer(uint32_t size, const char *name);
 	uint8_t *get_audio_buffer(const char *name, uint32_t *size = NULL);
 	bool audio_buffer_exists(const char *name);
+	void set_audio_buffer_ready(const char *name);
 	uint32_t get_audio_buffer_bytes_available(void) {return this->_audio_buffer_info.bytes_available;};
-	uint32_t get_siezed_channels(void) { return this->_busy_bits; };
+	uint32_t get_siezed_channels(void) { return Resource_mgr.get_busy_bits(Resource_Mgr::RT_TONE_CHANNEL); };
 	void send_audio_sequence(int32_t descriptor, const Audio_Sequence_List_Type *audio_sequence_list);
 
 
@@ -307,7 +310,6 @@ protected:
 
 
 
-	uint16_t _busy_bits;
 	channelInfo _channel_info[NUM_TONE_OUTPUTS];
 	osMessageQueueId_t _message_queue;
 	osMutexId_t _lock;
@@ -11,6 +11,8 @@ namespace Trunk {
 const uint8_t MAX_TRUNK_CARDS = 3;
 const uint8_t TRUNK_CARD_I2C_ADDRESS = 0x20;
 const uint8_t EVENT_MESSAGE_LENGTH = 1;
+const uint32_t MAX_SERVICE_STEPS = 8; /* Max state transitions per trunk per pass */
+const uint32_t MAX_SERVICE_PASSES = 4; /* Max passes over trunks with pending events */
 
 /* Registers for commands and status */
 enum {REG_GET_EVENT=0, REG_NONE=0, REG_GET_BUSY_STATUS=1, REG_SEIZE_TRUNK=2, REG_SEND_WINK=3, REG_INCOMING_CONNECTED=4,
@@ -20,7 +22,7 @@ REG_DROP_CALL=5, REG_OUTGOING_ADDR_COMPLETE=6, REG_RESET=7};
 enum {EV_NONE=0, EV_REQUEST_IR=1, EV_CALL_DROPPED=2, EV_NO_WINK=3, EV_SEND_ADDR_INFO=4, EV_FAREND_SUPV=5, EV_FAREND_DISC=6, EV_BUSY = 7};
 
 /* Trunk states */
-enum {TS_IDLE=0, TS_SEIZE_JUNCTOR=1, TS_SEIZE_TG=2, TS_SEIZE_MFR=3, TS_WAIT_ADDR_INFO=4, TS_HAVE_ADDR_INFO=5, TS_SEND_RINGING=6, TS_RINGING_TEARDOWN=7,
+enum {TS_IDLE=0, TS_SEIZE_JUNCTOR=1, TS_WAIT_ADDR_INFO=4, TS_HAVE_ADDR_INFO=5, TS_SEND_RINGING=6, TS_RINGING_TEARDOWN=7,
 	TS_SEND_BUSY=8, TS_SEND_CONGESTION=9, TS_INCOMING_FAILED=10, TS_INCOMING_WAIT_SUPV=11, TS_INCOMING_CONNECT_AUDIO=12, TS_INCOMING_ANSWERED=13,
 	TS_INCOMING_TEARDOWN=14, TS_OUTGOING_START=15, TS_WAIT_WINK_OR_BUSY=16, TS_OUTGOING_REQUEST_ADDR_INFO=17,
 	TS_OUTGOING_WAIT_ADDR_INFO=18, TS_GOT_NO_WINK=19, TS_RELEASE_TRUNK=20, TS_SEND_TRUNK_BUSY=21,
@@ -36,10 +38,12 @@ enum {TS_IDLE=0, TS_SEIZE_JUNCTOR=1, TS_SEIZE_TG=2, TS_SEIZE_MFR=3, TS_WAIT_ADDR
 
 class Trunk {
 protected:
-	uint8_t _trunk_to_service;
+	uint32_t _pending_trunks; /* Changed with atomic operations */
 	osMutexId_t _lock;
 	Connector::Conn_Info _conn_info[MAX_TRUNK_CARDS];
 	bool _test_pending_state(Connector::Conn_Info *tinfo);
+	void _post_event(uint32_t trunk_number);
+	void _service(uint8_t trunk);
 
 
 
@@ -49,7 +53,8 @@ public:
 	void _mf_sending_complete(uint32_t descriptor, void *data);
 	void event_handler(uint32_t event_type, uint32_t resource);
 	void init(void);
-	void poll(void);
+	void poll(bool tick);
+	void wake(uint32_t trunk_number);
 	bool go_offline(uint32_t trunk_number);
 	bool go_online(uint32_t trunk_number);
 	bool is_in_use(uint32_t trunk_number);
@@ -35,6 +35,16 @@ const uint32_t NUM_SHORT_STRINGS = 128;
 const uint32_t LONG_STRINGS_SIZE = 128;
 const uint32_t NUM_LONG_STRINGS = 16;
 
+/*
+ * Non-owning view of part of a string.
+ * The string it points into must outlive the span.
+ */
+
+typedef struct Str_Span {
+	const char *str;
+	uint32_t len;
+} Str_Span_Type;
+
 
 class Util {
 public:
@@ -62,6 +72,12 @@ public:
 	bool is_digits(const char *str);
 	bool is_routing_table_entry(const char *str);
 	char *trim(char *str);
+	uint32_t split(const char *str, Str_Span_Type spans[], uint32_t max_spans, char split_char);
+	bool span_copy(char *dest, const Str_Span_Type &span, uint32_t dest_size);
+	bool span_equals(const Str_Span_Type &span, const char *str);
+	int32_t span_keyword_match(const Str_Span_Type &span, const char *match_table[]);
+	bool span_to_unsigned(const Str_Span_Type &span, unsigned &value);
+	bool parse_unsigned(const char *str, unsigned &value);
 
 
 
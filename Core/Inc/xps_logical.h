@@ -8,15 +8,20 @@
 
 namespace XPS_Logical {
 
-const uint8_t MATRIX_DEPTH = 2;
+const uint8_t MATRIX_DEPTH = Xps::MAX_CPS_CHIPS; /* Maximum, the fitted number of chips is set in the configuration */
 const uint8_t PHYSICAL_NUM_X = Xps::MAX_ROWS;
 const uint8_t PHYSICAL_NUM_Y = Xps::MAX_COLUMNS;
 const uint8_t LOGICAL_NUM_X = (PHYSICAL_NUM_X * MATRIX_DEPTH);
 const uint8_t LOGICAL_NUM_Y = PHYSICAL_NUM_Y;
 const uint8_t LOGICAL_MAX_X = (PHYSICAL_NUM_X * MATRIX_DEPTH) - 1;
 const uint8_t LOGICAL_MAX_Y = PHYSICAL_NUM_Y - 1;
+const uint8_t MATRIX_ROW_BYTES = LOGICAL_NUM_X / 8;
 
-const uint8_t MAX_JUNCTORS = 4;
+/* Each junctor uses a pair of Y lines which are common to all the chips */
+const uint8_t MAX_JUNCTORS = PHYSICAL_NUM_Y / 2;
+const uint32_t JUNCTOR_MASK = (1 << MAX_JUNCTORS) - 1;
+
+const uint8_t MAX_BATCH_OPS = 16;
 
 const uint8_t MAX_SUB_LINES = 8;
 const uint8_t MAX_TRUNKS = 3;
@@ -24,6 +29,11 @@ const uint8_t MAX_TRUNKS = 3;
 const uint8_t PATH_ORIG_TO_TERM = 0; /* Even Y value */
 const uint8_t PATH_TERM_TO_ORIG = 1; /* Odd Y value */
 
+/* Resources which have a group of X columns on the fabric */
+enum {FC_LINES=0, FC_TRUNKS, FC_TONE_PLANT, FC_DTMF_RECEIVERS, FC_MF_RECEIVERS, NUM_FABRIC_COLUMN_GROUPS};
+
+/* Default column assignments */
+
 /* These have x values which increment by one */
 const uint8_t LINE_COLUMN_START = 0;
 const uint8_t TRUNK_COLUMN_START = 16;
@@ -37,6 +47,15 @@ const uint8_t MF_RECEIVER_COLUMN_START = 29;
 
 enum {RSRC_NONE=0, RSRC_LINE, RSRC_TRUNK, RSRC_MF_RCVR, RSRC_DTMF_RCVR, RSRC_TONE_PLANT};
 
+/* Fabric layout, from the fabric section of the configuration file */
+typedef struct Fabric_Geometry {
+	uint8_t num_chips;
+	uint8_t column_start[NUM_FABRIC_COLUMN_GROUPS];
+} Fabric_Geometry;
+
+const Fabric_Geometry DEFAULT_FABRIC_GEOMETRY = {2, {LINE_COLUMN_START, TRUNK_COLUMN_START, TONE_PLANT_COLUMN_START,
+		DTMF_RECEIVER_COLUMN_START, MF_RECEIVER_COLUMN_START}};
+
 
 typedef struct Phys_Switch {
 	uint8_t chip;
@@ -68,9 +87,13 @@ typedef struct Junctor_Info {
 class XPS_Logical {
 public:
 	void init(void);
+	void config(void);
+	bool parse_fabric_key(Fabric_Geometry *geometry, const char *key, const char *value);
+	const char *check_geometry(const Fabric_Geometry *geometry);
+	uint32_t get_num_x(void);
 
 	/* High level logical methods */
-	bool seize(Junctor_Info *info, int32_t requested_junctor_number = -1);
+	bool seize(Junctor_Info *info, int32_t requested_junctor_number = -1, void *owner = NULL);
 	void release(Junctor_Info *info);
 	void connect_phone_orig(Junctor_Info *info, int32_t phone_line_num_orig);
 	void disconnect_phone_orig(Junctor_Info *info);
@@ -87,6 +110,9 @@ public:
 	void connect_mf_receiver(Junctor_Info *info, int32_t mf_receiver_descriptor, bool orig_term = true);
 	void disconnect_mf_receiver(Junctor_Info *info);
 	void disconnect_all(Junctor_Info *info);
+	/* Batch switch changes */
+	void begin(void);
+	void commit(void);
 	/* Low level logical methods (mainly used for testing) */
 	void close_switch(uint32_t x, uint32_t y);
 	void open_switch(uint32_t x, uint32_t y);
@@ -97,6 +123,7 @@ public:
 
 protected:
 	bool _validate_descriptor(uint32_t descriptor);
+	uint8_t _get_column_x(uint32_t group, uint32_t index);
 	uint8_t get_mf_receiver_x(int32_t mf_descriptor);
 	uint8_t get_dtmf_receiver_x(int32_t dtmf_descriptor);
 	uint8_t get_tone_plant_x(int32_t tone_plant_descriptor);
@@ -104,11 +131,15 @@ protected:
 	uint8_t get_trunk_x(uint8_t trunk_number);
 	uint8_t get_path_y(uint8_t junctor_number, bool orig_term = true);
 	void _logical_to_physical(Phys_Switch *s, uint32_t x, uint32_t y);
+	void _set_switch(uint32_t x, uint32_t y, bool state);
+	uint32_t _apply_changes(bool state);
 
 
 	osMutexId_t _lock;
-	uint32_t _busy_bits;
-	uint8_t _matrix_state[(MATRIX_DEPTH * PHYSICAL_NUM_X * PHYSICAL_NUM_Y)/8];
+	uint32_t _batch_depth;
+	Fabric_Geometry _geometry;
+	uint8_t _matrix_state[(MATRIX_DEPTH * PHYSICAL_NUM_X * PHYSICAL_NUM_Y)/8]; /* State of the physical switches */
+	uint8_t _desired_state[(MATRIX_DEPTH * PHYSICAL_NUM_X * PHYSICAL_NUM_Y)/8]; /* State wanted once the batch is committed */
 
 };
 
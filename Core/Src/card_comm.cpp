@@ -1,3 +1,4 @@
+#include <string.h>
 #include "top.h"
 #include "logging.h"
 #include "err_handler.h"
@@ -42,30 +43,43 @@ void Card_Comm::_event_callback(uint32_t type, uint32_t status, uint32_t trans_i
 		POST_ERROR(Err_Handler::EH_IVCN);
 	}
 
+	Card_Context_Type *context = &this->_card_contexts[card];
+
 	if(status != I2C_Engine::I2CEC_OK) {
 		LOG_ERROR(TAG, "Get event failed with status %u on card %u", status, card);
-		this->_pending_bits &= ~(1 << card);
+		osMutexAcquire(this->_lock, osWaitForever);
+		this->_atten_stats[card].failures++;
+		osMutexRelease(this->_lock);
+		__atomic_fetch_and(&this->_pending_bits, ~(1UL << card), __ATOMIC_SEQ_CST);
 		return;
 	}
 
-	if(card < Sub_Line::MAX_DUAL_LINE_CARDS) {
-		/* Dual line card */
-		if(this->_event_handler) {
-			uint32_t type = this->_i2c_read_data[card][0]; /* Event type */
-			uint32_t resource = (2 * trans_id) + this->_i2c_read_data[card][1]; /* Physical subscriber line */
-			(*this->_event_handler)(type, resource);
-		}
+	/* Update the latency statistics */
+	osMutexAcquire(this->_lock, osWaitForever);
+	uint32_t latency = osKernelGetTickCount() - context->atten_time;
+	Atten_Stats_Type *stats = &this->_atten_stats[card];
+	stats->events++;
+	stats->total_latency += latency;
+	if(latency > stats->max_latency) {
+		stats->max_latency = latency;
 	}
-	else {
-		/* E&M trunk card */
-		if(this->_event_handler) {
-			uint32_t type = this->_i2c_read_data[card][0]; /* Event type */
-			uint32_t resource = card - Sub_Line::MAX_DUAL_LINE_CARDS;
-			(*this->_event_handler)(type, resource);
+	osMutexRelease(this->_lock);
+
+	/* Decode the event using the card's resource type */
+	if(context->handler) {
+		uint32_t type = context->read_data[0]; /* Event type */
+		uint32_t resource;
+		if(context->resource_type == RT_LINE) {
+			resource = (2 * card) + context->read_data[1]; /* Physical subscriber line */
 		}
+		else {
+			resource = card - Sub_Line::MAX_DUAL_LINE_CARDS; /* Physical trunk */
+		}
+		(*context->handler)(type, resource);
 	}
-	/* Clear the card's pending bit */
-	this->_pending_bits &= ~(1 << card);
+
+	/* Clear the card's pending bit. The context may be reused after this */
+	__atomic_fetch_and(&this->_pending_bits, ~(1UL << card), __ATOMIC_SEQ_CST);
 }
 
 void Card_Comm::init(void) {
@@ -77,6 +91,11 @@ void Card_Comm::init(void) {
 		};
 	this->_lock = osMutexNew(&card_comm_mutex_attr);
 
+	/* Set the resource type for each card position */
+	for(uint32_t card = 0; card < Atten::MAX_NUM_CARDS; card++) {
+		this->_card_contexts[card].resource_type = (card >= Sub_Line::MAX_DUAL_LINE_CARDS) ? RT_TRUNK : RT_LINE;
+	}
+
 }
 /*
  * Queue a request to retrieve a card's information
@@ -96,26 +115,30 @@ bool Card_Comm::queue_get_event_request(uint32_t card, Event_Handler handler) {
 	}
 
 
-	if(this->_pending_bits & (1 << card)){
-		/* Request is already in the queue */
+	/* Claim the card's context. If the pending bit was already set, a request is already in flight */
+	if(__atomic_fetch_or(&this->_pending_bits, (1UL << card), __ATOMIC_SEQ_CST) & (1UL << card)) {
 		res = false;
 	}
 	else {
 		/* New request */
 		LOG_DEBUG(TAG, "Card %d asserted ATTEN", card);
-		this->_event_handler = handler;
+		Card_Context_Type *context = &this->_card_contexts[card];
+		context->handler = handler;
+		context->atten_time = osKernelGetTickCount();
 
-		this->_pending_bits |= (1 << card);
-		uint32_t device_address = (card >= 4) ? Trunk::TRUNK_CARD_I2C_ADDRESS : Sub_Line::LINE_CARD_I2C_ADDRESS;
-		uint32_t register_address = (card >= 4) ? (uint32_t) Trunk::REG_GET_EVENT : (uint32_t) Sub_Line::REG_GET_EVENT;
-		uint32_t event_message_length = (card >= 4) ? Trunk::EVENT_MESSAGE_LENGTH : Sub_Line::EVENT_MESSAGE_LENGTH;
+		bool is_trunk = (context->resource_type == RT_TRUNK);
+		uint32_t device_address = (is_trunk) ? Trunk::TRUNK_CARD_I2C_ADDRESS : Sub_Line::LINE_CARD_I2C_ADDRESS;
+		uint32_t register_address = (is_trunk) ? (uint32_t) Trunk::REG_GET_EVENT : (uint32_t) Sub_Line::REG_GET_EVENT;
+		uint32_t event_message_length = (is_trunk) ? Trunk::EVENT_MESSAGE_LENGTH : Sub_Line::EVENT_MESSAGE_LENGTH;
 
-		bool res = I2c.queue_transaction(I2C_Engine::I2CT_READ_REG8, 0, card, device_address,
+		res = I2c.queue_transaction(I2C_Engine::I2CT_READ_REG8, 0, card, device_address,
 				register_address, event_message_length,
-				this->_i2c_read_data[card], __event_callback, card);
+				context->read_data, __event_callback, card);
 
 		if(!res) {
 			LOG_ERROR(TAG, "I2C Queue Transaction failed due to full queue");
+			/* Allow the request to be retried the next time ATTEN is sampled */
+			__atomic_fetch_and(&this->_pending_bits, ~(1UL << card), __ATOMIC_SEQ_CST);
 		}
 
 	}
@@ -125,11 +148,66 @@ bool Card_Comm::queue_get_event_request(uint32_t card, Event_Handler handler) {
 	return res;
 }
 
+/*
+ * Queue requests to retrieve the information from every card in a bit mask as a burst.
+ *
+ * Line cards get line_handler, trunk cards get trunk_handler.
+ * Returns the number of requests queued.
+ */
+
+uint32_t Card_Comm::queue_get_event_requests(uint32_t card_mask, Event_Handler line_handler, Event_Handler trunk_handler) {
+	uint32_t queued = 0;
+
+	/* Get the lock */
+	osStatus status = osMutexAcquire(this->_lock, osWaitForever);
+
+	if(status != osOK) {
+		POST_ERROR(Err_Handler::EH_LAF);
+	}
+
+	for(uint32_t card = 0; card < Atten::MAX_NUM_CARDS; card++) {
+		if(!(card_mask & (1 << card))) {
+			continue;
+		}
+		Event_Handler handler = (card >= Sub_Line::MAX_DUAL_LINE_CARDS) ? trunk_handler : line_handler;
+		if(this->queue_get_event_request(card, handler)) {
+			queued++;
+		}
+	}
+
+	osMutexRelease(this->_lock); /* Release the lock */
+
+	return queued;
+}
+
+/*
+ * Return a copy of the attention latency statistics for a card
+ */
+
+void Card_Comm::get_atten_stats(uint32_t card, Atten_Stats_Type &stats) {
+	if(card >= Atten::MAX_NUM_CARDS) {
+		POST_ERROR(Err_Handler::EH_IVCN);
+	}
+	osMutexAcquire(this->_lock, osWaitForever);
+	stats = this->_atten_stats[card];
+	osMutexRelease(this->_lock);
+}
+
+/*
+ * Clear the attention latency statistics for all cards
+ */
+
+void Card_Comm::clear_atten_stats(void) {
+	osMutexAcquire(this->_lock, osWaitForever);
+	memset(this->_atten_stats, 0, sizeof(this->_atten_stats));
+	osMutexRelease(this->_lock);
+}
+
 /*
  * Send a command to a line or trunk card
  */
 
-bool Card_Comm::send_command(uint32_t resource_type, uint32_t resource, uint32_t command,  uint32_t parameter) {
+bool Card_Comm::send_command(uint32_t resource_type, uint32_t resource, uint32_t command,  uint32_t parameter, uint32_t priority) {
 	uint32_t card;
 	uint32_t line;
 	bool res = true;
@@ -151,6 +229,9 @@ bool Card_Comm::send_command(uint32_t resource_type, uint32_t resource, uint32_t
 		}
 	}
 
+	/* Urgent commands go ahead of event reads and other normal traffic */
+	uint32_t i2c_priority = (priority == CP_URGENT) ? I2C_Engine::I2CP_HIGH : I2C_Engine::I2CP_NORMAL;
+
 	/* LOG_DEBUG(TAG, "Sending command %u to resourse %u, resource type %u, parameter %u",
 				command, resource, resource_type, parameter); */
 	/* Get the lock */
@@ -177,7 +258,7 @@ bool Card_Comm::send_command(uint32_t resource_type, uint32_t resource, uint32_t
 		}
 
 		res = I2c.queue_transaction(I2C_Engine::I2CT_WRITE_REG8, 0, card, Sub_Line::LINE_CARD_I2C_ADDRESS,
-			command, data_length, i2c_write_data, __event_callback_command, card);
+			command, data_length, i2c_write_data, __event_callback_command, card, i2c_priority);
 
 		if(!res) {
 			LOG_ERROR(TAG, "I2C Queue Transaction failed due to full queue");
@@ -188,7 +269,7 @@ bool Card_Comm::send_command(uint32_t resource_type, uint32_t resource, uint32_t
 	else { /* RT_TRUNK */
 		card = resource + Sub_Line::MAX_DUAL_LINE_CARDS;
 		res = I2c.queue_transaction(I2C_Engine::I2CT_WRITE_REG8, 0, card, Trunk::TRUNK_CARD_I2C_ADDRESS,
-			command, 0, i2c_write_data, __event_callback_command, card);
+			command, 0, i2c_write_data, __event_callback_command, card, i2c_priority);
 
 		if(!res) {
 			LOG_ERROR(TAG, "I2C Queue Transaction failed due to full queue");
@@ -25,6 +25,12 @@ static const char *SWITCH_CONF_FILE = "/config/switch.conf";
 const char *types[] = {"ringing", "receiver_lifted", "dial_tone", "digits_recognized", "trunk_signaling", "called_party_busy", "congestion", NULL};
 
 
+/*
+ * Configuration generation currently being validated
+ */
+
+static Config_Generation_Type *_validation_tree;
+
 /*
  * Function forward declarations
  */
@@ -37,7 +43,8 @@ static bool _phys_trunk_callback(const char *section, const char *key, const cha
  */
 
 static bool _outgoing_trunk_group(const char *section, const char *key, const char *value, uint32_t line_number, void *data) {
-	static const char *keywords[] = {"trunk_list", "start_index","prefix", NULL};
+	static const char *keywords[] = {"trunk_list", "start_index","prefix", "cut_through", NULL};
+	static const char *yes_no_keywords[] = {"yes", "no", NULL};
 
 	if(!data) {
 		POST_ERROR(Err_Handler::EH_NPFA);
@@ -51,30 +58,35 @@ static bool _outgoing_trunk_group(const char *section, const char *key, const ch
 		/* Value must contain something */
 		if(!value[0]) {
 			Config_rw.syntax_error(line_number, "No trunks defined");
+			return true;
 		}
 		/* Split the value into substrings */
 		/* These are the trunk section names */
 
-		char *substrings[4];
-		uint32_t substring_count = 4;
-		char *alloc_mem = Utility.str_split(value, substrings, substring_count, ',');
+		Util::Str_Span_Type substrings[4];
+		uint32_t substring_count = Utility.split(value, substrings, 4, ',');
 		uint32_t keyword_bits = 0;
+		char section_name[MAX_SECTION + 1];
+
+		if(substring_count > Connector::MAX_PHYS_LINE_TRUNK_TABLE) {
+			Config_rw.syntax_error(line_number, "Too many trunks in trunk group");
+			return true;
+		}
 
 		for(uint32_t index = 0; index < substring_count; index++) {
 
-			int32_t res = Config_rw.traverse_nodes(substrings[index], _phys_trunk_callback, (void *) &keyword_bits);
+			Utility.span_copy(section_name, substrings[index], sizeof(section_name));
+			int32_t res = Config_rw.traverse_nodes(section_name, _phys_trunk_callback, (void *) &keyword_bits, _validation_tree);
 			if(res == false) {
-				Utility.deallocate_long_string(alloc_mem);
-				Config_rw.syntax_error(0, "No physical trunks found");
+				Config_rw.syntax_error(line_number, "No physical trunks found");
+				break;
 			}
 			else if(keyword_bits != 7) {
-				Utility.deallocate_long_string(alloc_mem);
-				Config_rw.syntax_error(0, "Missing required keywords");
-
+				Config_rw.syntax_error(line_number, "Missing required keywords");
+				break;
 			}
 
 		}
-		Utility.deallocate_long_string(alloc_mem);
 		*caller_keyword_bits |= 0x8000; /* Indicate we saw the mandatory keyword */
 	}
 		break;
@@ -84,7 +96,7 @@ static bool _outgoing_trunk_group(const char *section, const char *key, const ch
 		if(!value[0]) {
 			Config_rw.syntax_error(line_number, "Missing start index");
 		}
-		if(!Utility.is_digits(value)) {
+		else if(!Utility.is_digits(value)) {
 			Config_rw.syntax_error(line_number, "Start index must be numeric");
 		}
 		break;
@@ -93,11 +105,17 @@ static bool _outgoing_trunk_group(const char *section, const char *key, const ch
 		if(!value[0]) {
 			Config_rw.syntax_error(line_number, "Missing prefix value");
 		}
-		if(!Utility.is_digits(value)) {
+		else if(!Utility.is_digits(value)) {
 			Config_rw.syntax_error(line_number, "Prefix must be numeric");
 		}
 		break;
 
+	case 3: /* Seize a trunk before the caller has finished dialing (optional) */
+		if(Utility.keyword_match(value, yes_no_keywords) < 0) {
+			Config_rw.syntax_error(line_number, "Cut through must be yes or no");
+		}
+		break;
+
 
 	default:
 		Config_rw.syntax_error(line_number, "Bad key");
@@ -123,35 +141,37 @@ static bool _outgoing_trunk_groups_callback(const char *section, const char *key
 	/* key must be trunk_list */
 	if(strcmp(key, "group_list")) {
 		Config_rw.syntax_error(line_number, "Trunk list not defined");
+		return true;
 	}
 
 	/* Value must contain something */
 	if(!value[0]) {
 		Config_rw.syntax_error(line_number, "No trunk groups");
+		return true;
 	}
 
 	/* Split the value into substrings */
 	/* These are the trunk section names */
 
-	char *substrings[8];
-	uint32_t substring_count = 8;
-	char *alloc_mem = Utility.str_split(value, substrings, substring_count, ',');
+	Util::Str_Span_Type substrings[8];
+	uint32_t substring_count = Utility.split(value, substrings, 8, ',');
+	char section_name[MAX_SECTION + 1];
 
 	for(uint32_t index = 0; index < substring_count; index++) {
 
-		int32_t res = Config_rw.traverse_nodes(substrings[index], _outgoing_trunk_group, &keyword_bits);
+		Utility.span_copy(section_name, substrings[index], sizeof(section_name));
+		int32_t res = Config_rw.traverse_nodes(section_name, _outgoing_trunk_group, &keyword_bits, _validation_tree);
 		if(!res) {
-			Utility.deallocate_long_string(alloc_mem);
-			Config_rw.syntax_error(0, "No trunk groups found");
+			Config_rw.syntax_error(line_number, "No trunk groups found");
+			break;
 		}
 
 		if(keyword_bits != 0x8000) {
-			Utility.deallocate_long_string(alloc_mem);
-			Config_rw.syntax_error(0, "Missing required keywords");
+			Config_rw.syntax_error(line_number, "Missing required keywords");
+			break;
 		}
 
 	}
-	Utility.deallocate_long_string(alloc_mem);
 	return true;
 }
 
@@ -174,12 +194,14 @@ static bool _phys_trunk_callback(const char *section, const char *key, const cha
 	int32_t keyword_index = Utility.keyword_match(key, permitted_keywords);
 	if(keyword_index == -1) {
 		Config_rw.syntax_error(line_number, "Bad key");
+		return true;
 	}
 	/* For each permitted keyword, set a bit to be checked by the caller */
 	switch(keyword_index) {
 	case 0: /* type */
 		if(strcmp(value, "e&m")) {
 			Config_rw.syntax_error(line_number, "Trunk type must be e&m");
+			break;
 		}
 
 		*keyword_bits |= 1;
@@ -187,13 +209,14 @@ static bool _phys_trunk_callback(const char *section, const char *key, const cha
 
 	case 1: { /* phys_trunk */
 		unsigned trunk_num;
-		int res = sscanf(value,"%u", &trunk_num);
-			if(res != 1) {
+			if(!Utility.parse_unsigned(value, trunk_num)) {
 				Config_rw.syntax_error(line_number, "Physical trunk not a number");
+				break;
 			}
 		/* Must not exceed the maximum number of trunk cards */
-		if(trunk_num > Trunk::MAX_TRUNK_CARDS) {
+		if(trunk_num >= Trunk::MAX_TRUNK_CARDS) {
 			Config_rw.syntax_error(line_number, "Trunk number exceeds maximum");
+			break;
 		}
 
 		*keyword_bits |= 2;
@@ -204,9 +227,10 @@ static bool _phys_trunk_callback(const char *section, const char *key, const cha
 	case 2:{ /* routing_table */
 		uint32_t equip_type = 2;
 		/* Check the routing table section supplied */
-		int32_t res = Config_rw.traverse_nodes(value, _routing_table_callback, (void *) &equip_type);
+		int32_t res = Config_rw.traverse_nodes(value, _routing_table_callback, (void *) &equip_type, _validation_tree);
 		if(res == false) {
 			Config_rw.syntax_error(line_number, "Routing table not found");
+			break;
 		}
 		*keyword_bits |= 4;
 		break;
@@ -230,23 +254,19 @@ static bool _phys_trunk_callback(const char *section, const char *key, const cha
 static bool _incoming_trunks_callback(const char *section, const char *key, const char *value, uint32_t line_number, void *data) {
 	unsigned key_num;
 	uint32_t keyword_bits = 0;
-	/* Key must be a number */
-	int res = sscanf(key,"%u", &key_num);
-		if(res != 1) {
-			Config_rw.syntax_error(line_number, "Physical trunk not a number");
-		}
-	/* Must not exceed the maximum number of trunk cards */
-	if(key_num > Trunk::MAX_TRUNK_CARDS) {
-		Config_rw.syntax_error(line_number, "Trunk number exceeds maximum");
+	/* Key must be a number, and must not exceed the maximum number of trunk cards */
+	/* Bad keys were reported when the section index was built */
+	if((!Utility.parse_unsigned(key, key_num)) || (key_num >= Trunk::MAX_TRUNK_CARDS)) {
+		return true;
 	}
 	/* Value check */
 
-	res = Config_rw.traverse_nodes(value, _phys_trunk_callback, (void *) &keyword_bits);
+	bool res = Config_rw.traverse_nodes(value, _phys_trunk_callback, (void *) &keyword_bits, _validation_tree);
 	if(res == false) {
 		Config_rw.syntax_error(line_number, "No physical trunks found");
 	}
-	if(keyword_bits != 7) {
-		Config_rw.syntax_error(0, "Missing required keywords");
+	else if(keyword_bits != 7) {
+		Config_rw.syntax_error(line_number, "Missing required keywords");
 	}
 
 	return true;
@@ -268,8 +288,9 @@ static bool _indications_callback(const char *section, const char *key, const ch
 	uint32_t *keyword_bits = (uint32_t *) data;
 
 	/* Split value into substrings */
-	uint32_t substring_count = 3;
-	char *indications_substrings[3];
+	uint32_t substring_count;
+	Util::Str_Span_Type indications_substrings[3];
+	char sample_path[MAX_VALUE + 1];
 	bool is_invalid = false;
 	int32_t method;
 
@@ -287,7 +308,7 @@ static bool _indications_callback(const char *section, const char *key, const ch
 		}
 		else {
 			/* Stat and load the file */
-			if((method == 2) &&(!Config_rw.stat_and_load_audio_sample(s_type, indications_substrings[1]))) {
+			if((method == 2) &&(!Config_rw.stat_and_register_audio_sample(s_type, sample_path))) {
 				is_invalid = true;
 			}
 			else if((method == 0) && substring_count != 1) {
@@ -315,7 +336,7 @@ static bool _indications_callback(const char *section, const char *key, const ch
 		}
 		else {
 			/* Stat and load the file */
-			if((method == 2) &&(!Config_rw.stat_and_load_audio_sample(s_type, indications_substrings[1]))) {
+			if((method == 2) &&(!Config_rw.stat_and_register_audio_sample(s_type, sample_path))) {
 					is_invalid = true;
 			}
 			else if((method == 0) && substring_count != 1) {
@@ -332,14 +353,21 @@ static bool _indications_callback(const char *section, const char *key, const ch
 
 	if(!value[0]) {
 		Config_rw.syntax_error(line_number, "Missing value(s)");
+		return true;
 	}
 
-	char *alloc_mem = Utility.str_split(value, indications_substrings, substring_count, ',');
+	substring_count = Utility.split(value, indications_substrings, 3, ',');
 
 	/* Must have one or two substrings only */
 	if((substring_count > 2)) {
-		Utility.deallocate_long_string(alloc_mem);
 		Config_rw.syntax_error(line_number, "Too many parameters");
+		return true;
+	}
+
+	/* Second substring is the audio sample path */
+	sample_path[0] = 0;
+	if(substring_count == 2) {
+		Utility.span_copy(sample_path, indications_substrings[1], sizeof(sample_path));
 	}
 
 
@@ -348,18 +376,18 @@ static bool _indications_callback(const char *section, const char *key, const ch
 
 	/* If no type match */
 	if(indication_type == -1) {
-		Utility.deallocate_long_string(alloc_mem);
 		Config_rw.syntax_error(line_number, "Invalid type");
+		return true;
 
 	}
 
 	/* Attempt to match a method keyword */
-	method = Utility.keyword_match(indications_substrings[0], methods);
+	method = Utility.span_keyword_match(indications_substrings[0], methods);
 
 	/* If no method match */
 	if(method  == -1) {
-		Utility.deallocate_long_string(alloc_mem);
 		Config_rw.syntax_error(line_number, "Invalid method");
+		return true;
 	}
 
 	/* Verify that the various combinations of type, method, and audio file are valid */
@@ -412,7 +440,6 @@ static bool _indications_callback(const char *section, const char *key, const ch
 		break;
 	}
 
-	Utility.deallocate_long_string(alloc_mem);
 	if(is_invalid) {
 		Config_rw.syntax_error(line_number, "Invalid method, type, or missing audio file");
 	}
@@ -432,35 +459,35 @@ static bool _routing_table_callback(const char *section, const char *key, const
 
 	if(!Utility.is_routing_table_entry(key)) {
 		Config_rw.syntax_error(line_number, "Not a routing table entry");
+		return true;
 	}
 	/* Split the value into substrings */
-	char *routing_table_substrings[3];
-	uint32_t substring_count = 3;
-	char *alloc_mem = Utility.str_split(value, routing_table_substrings, substring_count, ',');
+	Util::Str_Span_Type routing_table_substrings[3];
+	uint32_t substring_count = Utility.split(value, routing_table_substrings, 3, ',');
 	/* Must be exactly 2 substrings */
 	if(substring_count != 2){
-		Utility.deallocate_long_string(alloc_mem);
 		Config_rw.syntax_error(line_number, "Incorrect number of arguments");
+		return true;
 	}
 	const char *eqt_strings[] = {"sub","tg", NULL};
 	/* Validate destination types */
 	if((equip_type == 1)||(equip_type == 2)) {
 
-		if(Utility.keyword_match(routing_table_substrings[0], eqt_strings) == -1) {
-			Utility.deallocate_long_string(alloc_mem);
+		if(Utility.span_keyword_match(routing_table_substrings[0], eqt_strings) == -1) {
 			Config_rw.syntax_error(line_number, "Invalid equipment type");
+			return true;
 		}
 	}
 
 
 	/* Must be able to look up the physical subscriber line */
-	int32_t res = Config_rw.traverse_nodes(routing_table_substrings[1]);
+	char section_name[MAX_SECTION + 1];
+	Utility.span_copy(section_name, routing_table_substrings[1], sizeof(section_name));
+	int32_t res = Config_rw.traverse_nodes(section_name, NULL, NULL, _validation_tree);
 	if(res == false) {
-		Utility.deallocate_long_string(alloc_mem);
 		Config_rw.syntax_error(line_number, "Invalid physical subscriber line section");
 	}
 
-	Utility.deallocate_long_string(alloc_mem);
 	return true;
 }
 
@@ -484,6 +511,7 @@ static bool _phys_subscriber_callback(const char *section, const char *key, cons
 	int32_t match = Utility.keyword_match(key, permitted_keywords);
 	if(match == -1) {
 		Config_rw.syntax_error(line_number, "Bad key");
+		return true;
 	}
 
 	switch(match) {
@@ -497,9 +525,9 @@ static bool _phys_subscriber_callback(const char *section, const char *key, cons
 	case 1: { /* phys_line */
 		unsigned phys_line;
 		/* must be a number from 0 to 7 */
-		int res = sscanf(value,"%u", &phys_line);
-		if((res != 1) || (phys_line > 7)) {
+		if((!Utility.parse_unsigned(value, phys_line)) || (phys_line > 7)) {
 			Config_rw.syntax_error(line_number, "Bad physical line number");
+			break;
 		}
 		*keyword_bits |= 1;
 		break;
@@ -509,15 +537,17 @@ static bool _phys_subscriber_callback(const char *section, const char *key, cons
 	case 2: /* phone number */
 		if(!Utility.is_digits(value)) {
 			Config_rw.syntax_error(line_number, "Not digits");
+			break;
 		}
 		*keyword_bits |= 2;
 		break;
 
 	case 3: { /* routing table */
 		/* Check the routing table section supplied */
-		int32_t res = Config_rw.traverse_nodes(value, _routing_table_callback, (void *) &equip_type);
+		int32_t res = Config_rw.traverse_nodes(value, _routing_table_callback, (void *) &equip_type, _validation_tree);
 		if(res == false) {
 			Config_rw.syntax_error(line_number, "Routing table not found");
+			break;
 		}
 		*keyword_bits |= 4;
 		break;
@@ -538,15 +568,12 @@ static bool _subscriber_callback(const char *section, const char *key, const cha
 	/* Check key */
 	unsigned key_num;
 	uint32_t keyword_bits = 0;
-	int res = sscanf(key,"%u", &key_num);
-	if(res != 1) {
-		Config_rw.syntax_error(line_number, "Physical line not a number");
-	}
-	if(key_num > Sub_Line::MAX_DUAL_LINE_CARDS *2) {
-		Config_rw.syntax_error(line_number, "Physical line number out of range");
+	/* Bad keys were reported when the section index was built */
+	if((!Utility.parse_unsigned(key, key_num)) || (key_num >= Sub_Line::MAX_DUAL_LINE_CARDS *2)) {
+		return true;
 	}
 	/* Check Value by traversing the physical subscriber line sections */
-	res = Config_rw.traverse_nodes(value, _phys_subscriber_callback, (void *) &keyword_bits);
+	bool res = Config_rw.traverse_nodes(value, _phys_subscriber_callback, (void *) &keyword_bits, _validation_tree);
 	if(res) {
 		if(keyword_bits != 0x8007) {
 			/* Did not see all the required keywords */
@@ -561,6 +588,19 @@ static bool _subscriber_callback(const char *section, const char *key, const cha
 
 }
 
+/*
+ * Checks a fabric section key
+ */
+
+static bool _fabric_callback(const char *section, const char *key, const char *value, uint32_t line_number, void *data) {
+	XPS_Logical::Fabric_Geometry *geometry = (XPS_Logical::Fabric_Geometry *) data;
+
+	if(!Xps_logical.parse_fabric_key(geometry, key, value)) {
+		Config_rw.syntax_error(line_number, "Invalid fabric keyword or value");
+	}
+	return true;
+}
+
 /*
  * Check for valid label characters in string
  */
@@ -605,17 +645,24 @@ Config_Section_Type *Config_RW::_add_section(char *section_keyword) {
 		POST_ERROR(Err_Handler::EH_NPFA);
 	}
 
-	Config_Section_Type *new_section = (Config_Section_Type *) this->_section_pool.allocate_object();
+	Config_Generation_Type *gen = this->_loading;
+
+	if(gen->section_pool.get_num_allocated_objects() >= MAX_SECTION_BLOCKS) {
+		this->syntax_error(this->_line_number, "Too many sections");
+		return NULL;
+	}
+
+	Config_Section_Type *new_section = (Config_Section_Type *) gen->section_pool.allocate_object();
 
-	if(this->_section_head == NULL) {
+	if(gen->section_head == NULL) {
 		/* First section in list */
-		this->_section_head = this->_section_tail = new_section;
+		gen->section_head = gen->section_tail = new_section;
 	}
 	else {
 		/* Append to section to end of list */
-		this->_section_tail->next = new_section;
-		new_section->prev = this->_section_tail;
-		this->_section_tail = new_section;
+		gen->section_tail->next = new_section;
+		new_section->prev = gen->section_tail;
+		gen->section_tail = new_section;
 	}
 
 	Utility.strncpy_term(new_section->section, section_keyword, sizeof(new_section->section));
@@ -633,9 +680,20 @@ Config_Node_Type *Config_RW::_add_node(char *key, char *value) {
 		POST_ERROR(Err_Handler::EH_NPFA);
 	}
 
-	Config_Section_Type *cur_section = this->_section_tail;
+	Config_Generation_Type *gen = this->_loading;
+	Config_Section_Type *cur_section = gen->section_tail;
+
+	if(!cur_section) {
+		this->syntax_error(this->_line_number, "Key:value outside of a section");
+		return NULL;
+	}
 
-	Config_Node_Type *new_node = (Config_Node_Type *) this->_node_pool.allocate_object();
+	if(gen->node_pool.get_num_allocated_objects() >= MAX_NODE_BLOCKS) {
+		this->syntax_error(this->_line_number, "Too many keys");
+		return NULL;
+	}
+
+	Config_Node_Type *new_node = (Config_Node_Type *) gen->node_pool.allocate_object();
 
 	/* Initialize the node data */
 	new_node->line_number = this->_line_number;
@@ -677,8 +735,11 @@ void Config_RW::_process_line(void) {
 			/* A section header will have an opening brace at the first character position*/
 			if(this->_line_buffer[0] == '[') {
 				/* Section header? */
-				char *section_keyword = Utility.strdup_until(this->_line_buffer + 1, ']', LINE_BUFFER_SIZE);
-				if(section_keyword) {
+				char *section_keyword = this->_line_buffer + 1;
+				char *closing_brace = strchr(section_keyword, ']');
+				if(closing_brace) {
+					/* Terminate the keyword in place */
+					*closing_brace = 0;
 					/* Test for valid label */
 					if(!this->_is_valid_label(section_keyword)){
 						this->syntax_error(this->_line_number, "Bad character in name");
@@ -687,8 +748,6 @@ void Config_RW::_process_line(void) {
 						/* Create a new section */
 						this->_add_section(section_keyword);
 					}
-					/* Free the section keyword storage */
-					Utility.deallocate_long_string(section_keyword);
 				}
 				else {
 					this->syntax_error(this->_line_number, "Bad section label");
@@ -697,22 +756,22 @@ void Config_RW::_process_line(void) {
 			}
 			else {
 				/* Most a likely key/value, test for correct syntax */
-				uint32_t num_substrings = 2;
-				char *substrings[2];
-				char *alloc_str = Utility.str_split(this->_line_buffer, substrings, num_substrings, ':');
-
-				if((num_substrings != 2) ||
-						(!strlen(substrings[0])) ||
-						(!strlen(substrings[1])) ||
-						(!this->_is_valid_label(substrings[0]))) {
+				char *value = strchr(this->_line_buffer, ':');
+				if(value) {
+					/* Split the line in place */
+					*value++ = 0;
+				}
+
+				if((!value) ||
+						(!strlen(this->_line_buffer)) ||
+						(!strlen(value)) ||
+						(!this->_is_valid_label(this->_line_buffer))) {
 					this->syntax_error(this->_line_number,"Bad key:value");
 
 				}
 				else {
-					this->_add_node(substrings[0], substrings[1]);
+					this->_add_node(this->_line_buffer, value);
 				}
-
-				Utility.deallocate_long_string(alloc_str);
 			}
 
 
@@ -773,9 +832,9 @@ int32_t Config_RW::_read_line(void) {
  * if not found, then return NULL
  */
 
-Config_Section_Type *Config_RW::find_section(const char *section_name) {
+Config_Section_Type *Config_RW::find_section(const char *section_name, Config_Generation_Type *gen) {
 	Config_Section_Type *config_section;
-	for(config_section = this->_section_head; config_section; config_section = config_section->next) {
+	for(config_section = this->_tree(gen)->section_head; config_section; config_section = config_section->next) {
 		if(!strcmp(config_section->section, section_name)) {
 			break;
 		}
@@ -810,7 +869,7 @@ Config_Node_Type *Config_RW::find_node(unsigned num, Config_Node_Type *node_head
 	Config_Node_Type *config_node;
 	unsigned sl_num;
 	for(config_node = node_head; config_node; config_node = config_node->next) {
-		if(sscanf(config_node->key, "%u", &sl_num) != 1) {
+		if(!Utility.parse_unsigned(config_node->key, sl_num)) {
 				POST_ERROR(Err_Handler::EH_IPLN);
 			}
 			/* Check to see if we found the node */
@@ -823,22 +882,61 @@ Config_Node_Type *Config_RW::find_node(unsigned num, Config_Node_Type *node_head
 
 }
 
+/*
+ * Attempt to find a node by key number using the numeric index of a section.
+ * Falls back to a linear search if the section isn't indexed.
+ * If found, then return a pointer to the node
+ * if not found, then return NULL
+ */
+
+Config_Node_Type *Config_RW::find_node(unsigned num, Config_Section_Type *section) {
+	if(!section) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	if(!section->index) {
+		return this->find_node(num, section->head);
+	}
+
+	return (num < section->index_size) ? section->index[num] : NULL;
+}
+
+/*
+ * Find a node in a section by its key.
+ * Numeric keys in indexed sections are looked up directly.
+ */
+
+Config_Node_Type *Config_RW::_find_key(Config_Section_Type *section, const Util::Str_Span_Type &key) {
+	unsigned key_num;
+	if((section->index) && Utility.span_to_unsigned(key, key_num)) {
+		return this->find_node(key_num, section);
+	}
+
+	Config_Node_Type *config_node;
+	for(config_node = section->head; config_node; config_node = config_node->next) {
+		if(Utility.span_equals(key, config_node->key)) {
+			break;
+		}
+	}
+	return config_node;
+}
+
 /*
  * Helper function for find_node_by_path
  */
 
-Config_Node_Type *Config_RW::_find_node_by_path_helper(const char *section, char **substrings, uint32_t num_substrings, uint32_t index) {
+Config_Node_Type *Config_RW::_find_node_by_path_helper(Config_Generation_Type *gen, const char *section, const Util::Str_Span_Type *substrings, uint32_t num_substrings, uint32_t index) {
 
 
 	/* Look up the section */
-	Config_Section_Type *section_info = this->find_section(section);
+	Config_Section_Type *section_info = this->find_section(section, gen);
 	if(!section_info) {
 		return NULL; /* Section not found */
 	}
 	Config_Node_Type *res = NULL;
 
 	/* Get the node key referenced by the substring */
-	Config_Node_Type *node = this->find_node(substrings[index], section_info->head);
+	Config_Node_Type *node = this->_find_key(section_info, substrings[index]);
 	if(!node) {
 		return res; /* Node not found */
 
@@ -846,7 +944,7 @@ Config_Node_Type *Config_RW::_find_node_by_path_helper(const char *section, char
 
 	if(index < num_substrings - 1) {
 		/* Not the last substring */
-		res = this->_find_node_by_path_helper(node->value, substrings, num_substrings, ++index);
+		res = this->_find_node_by_path_helper(gen, node->value, substrings, num_substrings, ++index);
 	}
 	else {
 		/* Was the last substring */
@@ -863,35 +961,26 @@ Config_Node_Type *Config_RW::_find_node_by_path_helper(const char *section, char
  * in the configuration tree.
  */
 
-Config_Node_Type *Config_RW::find_node_by_path(const char *starting_section, const char *path) {
-
-	if((!starting_section) || (!path)) {
-		POST_ERROR(Err_Handler::EH_NPFA);
-	}
-
-	if(!path[0]) {
-		return NULL;
-	}
+Config_Node_Type *Config_RW::_resolve_path(Config_Generation_Type *gen, const char *starting_section, const char *path) {
 
 	/* Look up the starting section */
-	Config_Section_Type *section_info = this->find_section(starting_section);
+	Config_Section_Type *section_info = this->find_section(starting_section, gen);
 
 	if(!section_info) {
 		return NULL; /* Starting section not found */
 	}
 
 	/* Split path on forward slash boundaries */
-	uint32_t num_path_components = 8; /* Maximum number of substrings in the path */
 	uint32_t index = 0;
-	char *substrings[8];
-	char *alloc_str = Utility.str_split(path, substrings, num_path_components, '/');
+	Util::Str_Span_Type substrings[8]; /* Maximum number of substrings in the path */
+	uint32_t num_path_components = Utility.split(path, substrings, 8, '/');
 	Config_Node_Type *res = NULL;
 	/* First substring is the node key in the section */
-	Config_Node_Type *node = this->find_node(substrings[index], section_info->head);
+	Config_Node_Type *node = this->_find_key(section_info, substrings[index]);
 	if(node) {
 		/* Desired node found in starting section */
 		if(index < num_path_components - 1) {
-			res = this->_find_node_by_path_helper(node->value, substrings, num_path_components, ++index);
+			res = this->_find_node_by_path_helper(gen, node->value, substrings, num_path_components, ++index);
 		}
 		else {
 			/* Did not need to recurse */
@@ -899,52 +988,248 @@ Config_Node_Type *Config_RW::find_node_by_path(const char *starting_section, con
 		}
 	}
 
+	return res;
+
+}
 
+/*
+ * Find a node from a starting section when given a path.
+ *
+ * Resolved paths are kept in a small least recently used cache in each generation.
+ * A new generation starts with an empty cache, so a reload invalidates it.
+ *
+ * If the path can't be found, return NULL, otherwise return a pointer to the node
+ * in the configuration tree. If gen is NULL, the current generation is searched.
+ */
+
+Config_Node_Type *Config_RW::find_node_by_path(const char *starting_section, const char *path, Config_Generation_Type *gen) {
+
+	if((!starting_section) || (!path)) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	if(!path[0]) {
+		return NULL;
+	}
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+
+	gen = this->_tree(gen);
+	bool cacheable = (strlen(path) <= MAX_CACHED_PATH) && (strlen(starting_section) <= MAX_SECTION);
+	Config_Path_Cache_Entry_Type *victim = &gen->path_cache[0];
+	Config_Node_Type *res = NULL;
+
+	if(cacheable) {
+		/* Look for the path in the cache, and note the least recently used entry */
+		for(uint32_t i = 0; i < PATH_CACHE_ENTRIES; i++) {
+			Config_Path_Cache_Entry_Type *entry = &gen->path_cache[i];
+			if((entry->node) && (!strcmp(entry->path, path)) && (!strcmp(entry->starting_section, starting_section))) {
+				entry->last_used = ++gen->cache_clock;
+				gen->cache_hits++;
+				res = entry->node;
+				break;
+			}
+			if(!victim->node) {
+				continue; /* Already found an empty entry */
+			}
+			if((!entry->node) || (entry->last_used < victim->last_used)) {
+				victim = entry;
+			}
+		}
+	}
+
+	if(!res) {
+		gen->cache_misses++;
+		res = this->_resolve_path(gen, starting_section, path);
+		/* Only successful resolutions are cached */
+		if(res && cacheable) {
+			Utility.strncpy_term(victim->starting_section, starting_section, sizeof(victim->starting_section));
+			Utility.strncpy_term(victim->path, path, sizeof(victim->path));
+			victim->last_used = ++gen->cache_clock;
+			victim->node = res;
+		}
+	}
+
+	osMutexRelease(this->_lock); /* Release the lock */
 
-	Utility.deallocate_long_string(alloc_str);
 	return res;
 
 }
 
+/*
+ * Return the path cache statistics for the current generation
+ */
+
+void Config_RW::get_path_cache_stats(uint32_t &hits, uint32_t &misses, uint32_t &entries_used) {
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+
+	Config_Generation_Type *gen = this->_current;
+	hits = gen->cache_hits;
+	misses = gen->cache_misses;
+	entries_used = 0;
+	for(uint32_t i = 0; i < PATH_CACHE_ENTRIES; i++) {
+		if(gen->path_cache[i].node) {
+			entries_used++;
+		}
+	}
+
+	osMutexRelease(this->_lock); /* Release the lock */
+}
+
 /*
  * Check to see that a sample file exists. If it doesn't then return false.
- * If it exists, then load it into a named sample buffer and tag it with the sample name.
+ *
+ * If it exists, reserve a named sample buffer for it and register it to be loaded by the prefetch task.
+ * The sample isn't used until it has been loaded, so precise tones are sent until then.
  */
 
-bool Config_RW::stat_and_load_audio_sample(const char *sample_name, const char *sample_path) {
+bool Config_RW::stat_and_register_audio_sample(const char *sample_name, const char *sample_path) {
 	LOG_DEBUG(TAG, "Opening audio file: %s", sample_path);
 	int fd = File_io.open(sample_path, File_Io::O_RDONLY);
-	if(fd >= 0) {
-		/* Get file size */
-		uint32_t audio_sample_size = File_io.fsize(fd);
-		/* Attempt buffer allocaiton */
-		uint8_t *buffer = Tone_plant.allocate_audio_buffer(audio_sample_size, sample_name);
-		/* If buffer successfully allocated */
-		if(buffer) {
-			if(File_io.read(fd, buffer, audio_sample_size) != -1) {
-				LOG_DEBUG(TAG,"Audio sample file loaded successfully");
-			}
+	if(fd < 0) {
+		LOG_ERROR(TAG, "Could not open audio file %s", sample_path);
+		if(this->_errors_are_fatal) {
+			POST_ERROR(Err_Handler::EH_NSFL);
 		}
-		else {
-			/* Buffer allocation failed */
-			LOG_ERROR(TAG, "No more space left in audio sample buffer");
-			POST_ERROR(Err_Handler::EH_NMA);
+		return false;
+	}
+	/* Get file size */
+	uint32_t audio_sample_size = File_io.fsize(fd);
+	File_io.close(fd);
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+
+	/* Audio buffers can't be freed, so a reload keeps the sample registered at boot */
+	for(uint32_t index = 0; index < this->_num_audio_assets; index++) {
+		if(!strcmp(this->_audio_assets[index].name, sample_name)) {
+			osMutexRelease(this->_lock);
+			LOG_DEBUG(TAG, "Audio sample %s already registered", sample_name);
+			return true;
 		}
-		/* Close the file */
-		LOG_DEBUG(TAG, "Closing the audio file");
-		File_io.close(fd);
 	}
-	else {
-		LOG_ERROR(TAG, "Could not open audio file");
-		POST_ERROR(Err_Handler::EH_NSFL);
+
+	/* Attempt buffer allocation */
+	uint8_t *buffer = NULL;
+	if(this->_num_audio_assets < MAX_AUDIO_ASSETS) {
+		buffer = Tone_plant.allocate_audio_buffer(audio_sample_size, sample_name);
+	}
+	if(!buffer) {
+		/* Buffer allocation failed */
+		osMutexRelease(this->_lock);
+		LOG_ERROR(TAG, "No more space left in audio sample buffer");
+		if(this->_errors_are_fatal) {
+			POST_ERROR(Err_Handler::EH_NMA);
+		}
+		return false;
 	}
 
-	/* Wait for log messages to be sent */
-	Logger.flush();
+	Config_Audio_Asset_Type *asset = &this->_audio_assets[this->_num_audio_assets++];
+	asset->name = sample_name;
+	Utility.strncpy_term(asset->path, sample_path, MAX_VALUE + 1);
+	asset->buffer = buffer;
+	asset->size = audio_sample_size;
+	asset->done = false;
+
+	osMutexRelease(this->_lock); /* Release the lock */
 
 	return true;
 }
 
+/*
+ * Prefetch task entry point
+ */
+
+void Config_RW::_prefetch_task(void *args) {
+	Config_rw._prefetch_worker();
+}
+
+/*
+ * Start the low priority prefetch task if there are audio samples waiting to be loaded
+ */
+
+void Config_RW::start_prefetch(void) {
+	static const osThreadAttr_t prefetch_attr = {
+			"AudioPrefetchThread",
+			osThreadDetached,
+			NULL,
+			0,
+			NULL,
+			2048,
+			osPriorityLow,
+			0,
+			0
+	};
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+
+	bool pending = false;
+	for(uint32_t index = 0; index < this->_num_audio_assets; index++) {
+		if(!this->_audio_assets[index].done) {
+			pending = true;
+			break;
+		}
+	}
+
+	if(pending && !this->_prefetch_running) {
+		this->_prefetch_running = true;
+		if(osThreadNew(_prefetch_task, NULL, &prefetch_attr) == NULL) {
+			POST_ERROR(Err_Handler::EH_TSF);
+		}
+	}
+
+	osMutexRelease(this->_lock); /* Release the lock */
+}
+
+/*
+ * Load each registered audio sample, then exit.
+ *
+ * A sample is made visible to the tone plant only after all of its data has been read.
+ */
+
+void Config_RW::_prefetch_worker(void) {
+	uint32_t start_time = osKernelGetTickCount();
+	uint32_t loaded = 0;
+
+	for(;;) {
+		osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+		Config_Audio_Asset_Type *asset = NULL;
+		for(uint32_t index = 0; index < this->_num_audio_assets; index++) {
+			if(!this->_audio_assets[index].done) {
+				asset = &this->_audio_assets[index];
+				break;
+			}
+		}
+		if(!asset) {
+			this->_prefetch_running = false;
+			osMutexRelease(this->_lock);
+			break;
+		}
+		osMutexRelease(this->_lock); /* Release the lock */
+
+		/* Registered assets are never removed, so the asset can be used without the lock */
+		int fd = File_io.open(asset->path, File_Io::O_RDONLY);
+		if((fd >= 0) && (File_io.read(fd, asset->buffer, (int32_t) asset->size) == (int32_t) asset->size)) {
+			Tone_plant.set_audio_buffer_ready(asset->name);
+			LOG_DEBUG(TAG, "Audio sample %s loaded", asset->name);
+			loaded++;
+		}
+		else {
+			LOG_ERROR(TAG, "Could not load audio file %s, using precise tones", asset->path);
+		}
+		if(fd >= 0) {
+			File_io.close(fd);
+		}
+
+		osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+		asset->done = true;
+		osMutexRelease(this->_lock); /* Release the lock */
+	}
+
+	LOG_INFO(TAG, "Loaded %u audio sample(s) in %u ms", (unsigned) loaded, (unsigned) (osKernelGetTickCount() - start_time));
+	osThreadExit();
+}
+
 /*
  * Return the name of a sample buffer if it has been preloaded into memory
  * otherwise return NULL.
@@ -966,49 +1251,52 @@ const char *Config_RW::get_progress_tone_buffer_name(uint32_t pt_type) {
 
 
 /*
- * Called after RTOS is up and running
+ * Return the generation to search.
+ *
+ * If gen is NULL, the current generation is used.
  */
 
-void Config_RW::init(void) {
-
-
-
-	/* Mutex attributes */
-	static const osMutexAttr_t configrw_allocator_mutex_attr = {
-		"ConfigRWAllocatorMutex",
-		osMutexRecursive | osMutexPrioInherit,
-		NULL,
-		0U
-	};
-
+Config_Generation_Type *Config_RW::_tree(Config_Generation_Type *gen) {
+	return (gen) ? gen : this->_current;
+}
 
-	/* Create the lock mutex */
+/*
+ * Read the configuration file into the configuration tree of a generation
+ *
+ * Returns true if the file was read in its entirety
+ */
 
-	this->_lock = osMutexNew(&configrw_allocator_mutex_attr);
-	if (this->_lock == NULL) {
-		POST_ERROR(Err_Handler::EH_LCE);
-	}
+bool Config_RW::_load(Config_Generation_Type *gen) {
 
-	/* Initialize memory pools */
-	this->_section_pool.pool_init(this->_section_memory_pool, sizeof(Config_Section_Type), MAX_SECTION_BLOCKS);
-	this->_node_pool.pool_init(this->_node_memory_pool, sizeof(Config_Node_Type), MAX_NODE_BLOCKS);
+	/* Return all sections and nodes from a previous load to the pools */
+	gen->section_pool.pool_reset();
+	gen->node_pool.pool_reset();
+	gen->section_head = NULL;
+	gen->section_tail = NULL;
+	gen->index_entries_used = 0;
+	this->_error_count = 0;
+	gen->cache_clock = gen->cache_hits = gen->cache_misses = 0;
+	Utility.memset(gen->path_cache, 0, sizeof(gen->path_cache));
+	this->_loading = gen;
 
 	/* Open the config file */
 	if((this->_fd = File_io.open(SWITCH_CONF_FILE, File_Io::O_RDONLY)) < 0) {
 		LOG_ERROR(TAG, "File system error: %s", File_io.error_string(this->_fd));
-		POST_ERROR(Err_Handler::EH_NOCF);
+		if(this->_errors_are_fatal) {
+			POST_ERROR(Err_Handler::EH_NOCF);
+		}
+		return false;
 	}
 
 	LOG_INFO(TAG,"Switch config file: %s opened successfully", SWITCH_CONF_FILE);
 
 	/* Read the configuration into the configuration tree */
-	this->_section_head = NULL;
-	this->_section_tail = NULL;
 	bool done = false;
+	bool res = true;
 	this->_line_number = 1;
 	while(!done) {
-		int32_t res = this->_read_line();
-		switch(res) {
+		int32_t rl_res = this->_read_line();
+		switch(rl_res) {
 		case RL_OK:
 			/* Process line */
 			this->_process_line();
@@ -1021,13 +1309,21 @@ void Config_RW::init(void) {
 			break;
 
 		case RL_FS_ERR:
-			LOG_ERROR(TAG, "File system error: %s", File_io.error_string(res));
-			POST_ERROR(Err_Handler::EH_FSER);
+			LOG_ERROR(TAG, "File system error: %s", File_io.error_string(rl_res));
+			if(this->_errors_are_fatal) {
+				POST_ERROR(Err_Handler::EH_FSER);
+			}
+			res = false;
+			done = true;
 			break;
 
 		case RL_TRUNC_LINE:
 			LOG_ERROR(TAG, "Line %u is too long, max is %u characters", this->_line_number, LINE_BUFFER_SIZE);
-			POST_ERROR(Err_Handler::EH_CFER);
+			if(this->_errors_are_fatal) {
+				POST_ERROR(Err_Handler::EH_CFER);
+			}
+			res = false;
+			done = true;
 			break;
 		}
 		this->_line_number++;
@@ -1036,25 +1332,85 @@ void Config_RW::init(void) {
 	File_io.close(this->_fd);
 	LOG_INFO(TAG, "Switch config file closed");
 
-	/*
-	 * Check for mandatory sections, then validate the sections.
-	 */
+	this->_loading = NULL;
+
+	return res;
+}
+
+/*
+ * Build a dense index for a section where every key is a physical line or trunk number.
+ *
+ * Keys which aren't numbers, are out of range, or are duplicated are syntax errors.
+ */
+
+void Config_RW::_build_numeric_index(Config_Generation_Type *gen, const char *section_name, uint32_t max_keys) {
+
+	Config_Section_Type *section = this->find_section(section_name, gen);
+	if(!section) {
+		return; /* Missing section is reported by the validator */
+	}
+
+	if(gen->index_entries_used + max_keys > MAX_INDEX_ENTRIES) {
+		POST_ERROR(Err_Handler::EH_NMA);
+	}
+
+	Config_Node_Type **index = &gen->index_memory[gen->index_entries_used];
+	gen->index_entries_used += max_keys;
+	for(uint32_t i = 0; i < max_keys; i++) {
+		index[i] = NULL;
+	}
+
+	for(Config_Node_Type *node = section->head; node; node = node->next) {
+		unsigned key_num;
+		if(!Utility.parse_unsigned(node->key, key_num)) {
+			this->syntax_error(node->line_number, "Key must be a number");
+			continue;
+		}
+		if(key_num >= max_keys) {
+			this->syntax_error(node->line_number, "Key number out of range");
+			continue;
+		}
+		if(index[key_num]) {
+			LOG_ERROR(TAG, "Key %u first defined on line %u", key_num, index[key_num]->line_number);
+			this->syntax_error(node->line_number, "Duplicate key");
+			continue;
+		}
+		index[key_num] = node;
+	}
+
+	section->index = index;
+	section->index_size = max_keys;
+}
+
+/*
+ * Check for mandatory sections, then validate the sections.
+ *
+ * Returns true if no syntax errors were found
+ */
+
+bool Config_RW::_validate(Config_Generation_Type *gen) {
+
+	_validation_tree = gen;
+
+	/* Index the sections keyed by physical line and trunk number */
+	this->_build_numeric_index(gen, "subscribers", Sub_Line::MAX_DUAL_LINE_CARDS * 2);
+	this->_build_numeric_index(gen, "incoming_trunks", Trunk::MAX_TRUNK_CARDS);
 
 	/* Subscribers section */
 	LOG_INFO(TAG, "Validating subscribers section");
-	if(!this->traverse_nodes("subscribers", _subscriber_callback)) {
+	if(!this->traverse_nodes("subscribers", _subscriber_callback, NULL, gen)) {
 		this->syntax_error(0,"Subscriber section is missing");
 	}
 
 	/* Incoming trunks section */
 	LOG_INFO(TAG, "Validating incoming trunks section");
-	if(!this->traverse_nodes("incoming_trunks", _incoming_trunks_callback)) {
+	if(!this->traverse_nodes("incoming_trunks", _incoming_trunks_callback, NULL, gen)) {
 		this->syntax_error(0,"Incoming trunks section is missing");
 	}
 
 	/* Outgoing trunk groups section */
 	LOG_INFO(TAG, "Validating outgoing trunks section");
-	if(!this->traverse_nodes("outgoing_trunk_groups", _outgoing_trunk_groups_callback)) {
+	if(!this->traverse_nodes("outgoing_trunk_groups", _outgoing_trunk_groups_callback, NULL, gen)) {
 		this->syntax_error(0,"Outgoing trunk groups section is missing");
 	}
 
@@ -1064,22 +1420,97 @@ void Config_RW::init(void) {
 	uint32_t keyword_bits = 0;
 	LOG_INFO(TAG, "Validating indications section");
 
-	if(!this->traverse_nodes("indications", _indications_callback, &keyword_bits)) {
+	if(!this->traverse_nodes("indications", _indications_callback, &keyword_bits, gen)) {
 		this->syntax_error(0,"Indications section is missing");
 	}
-	if(keyword_bits != 0x7F) {
+	else if(keyword_bits != 0x7F) {
 		this->syntax_error(0,"Not all indication types were defined");
 	}
 
+	/* Fabric, optional */
+	XPS_Logical::Fabric_Geometry geometry = XPS_Logical::DEFAULT_FABRIC_GEOMETRY;
+	LOG_INFO(TAG, "Validating fabric section");
+	if(this->traverse_nodes("fabric", _fabric_callback, &geometry, gen)) {
+		const char *problem = Xps_logical.check_geometry(&geometry);
+		if(problem) {
+			this->syntax_error(0, problem);
+		}
+	}
+
+	_validation_tree = NULL;
+
 	LOG_INFO(TAG, "Validation complete");
 
+	return (this->_error_count == 0);
+}
+
+/*
+ * Log config tree usage statistics for a generation
+ */
+
+void Config_RW::_log_usage(Config_Generation_Type *gen) {
+	LOG_INFO(TAG, "Used %u sections out of %u available", gen->section_pool.get_num_allocated_objects(), MAX_SECTION_BLOCKS );
+	LOG_INFO(TAG, "Used %u nodes out of %u available", gen->node_pool.get_num_allocated_objects(), MAX_NODE_BLOCKS );
+}
 
+/*
+ * Called after RTOS is up and running
+ */
+
+void Config_RW::init(void) {
+
+
+
+	/* Mutex attributes */
+	static const osMutexAttr_t configrw_allocator_mutex_attr = {
+		"ConfigRWAllocatorMutex",
+		osMutexRecursive | osMutexPrioInherit,
+		NULL,
+		0U
+	};
+
+
+	/* Create the lock mutex */
+
+	this->_lock = osMutexNew(&configrw_allocator_mutex_attr);
+	if (this->_lock == NULL) {
+		POST_ERROR(Err_Handler::EH_LCE);
+	}
+
+	/* Initialize memory pools for each generation */
+	for(uint32_t index = 0; index < NUM_CONFIG_GENERATIONS; index++) {
+		Config_Generation_Type *gen = &this->_generations[index];
+		gen->section_pool.pool_init(gen->section_memory_pool, sizeof(Config_Section_Type), MAX_SECTION_BLOCKS);
+		gen->node_pool.pool_init(gen->node_memory_pool, sizeof(Config_Node_Type), MAX_NODE_BLOCKS);
+		gen->ref_count = 0;
+		gen->number = 0;
+	}
+
+	/* File system and memory errors found at boot time are fatal */
+	this->_errors_are_fatal = true;
+	this->_reload_in_progress = false;
+	this->_num_audio_assets = 0;
+	this->_prefetch_running = false;
+
+	/* Read and validate the first generation */
+	Config_Generation_Type *gen = &this->_generations[0];
+	this->_load(gen);
+	/* Report every syntax error before giving up */
+	if(!this->_validate(gen)) {
+		LOG_ERROR(TAG, "Found %u error(s) in %s", this->_error_count, SWITCH_CONF_FILE);
+		this->_log_usage(gen);
+		POST_ERROR(Err_Handler::EH_CFSE);
+	}
+	gen->number = 1;
+	this->_current = gen;
+
+	/* File system and memory errors found after boot time are reported, but not fatal */
+	this->_errors_are_fatal = false;
 
 	/*
 	 * Log config tree usage statistics
 	 */
-	LOG_INFO(TAG, "Used %u sections out of %u available", this->_section_pool.get_num_allocated_objects(), MAX_SECTION_BLOCKS );
-	LOG_INFO(TAG, "Used %u nodes out of %u available", this->_node_pool.get_num_allocated_objects(), MAX_NODE_BLOCKS );
+	this->_log_usage(gen);
 
 	/*
 	 * Log audio buffer bytes available
@@ -1095,6 +1526,137 @@ void Config_RW::init(void) {
 
 }
 
+/*
+ * Reload the configuration file while the switch is running.
+ *
+ * The file is read into the spare generation and validated. If it is valid,
+ * new calls are switched over to it. Calls in progress keep the generation they acquired.
+ * The spare generation can't be reused until every call referencing it has ended.
+ *
+ * Audio samples loaded at boot time are kept. Changing a sample requires a reboot.
+ *
+ * If check_only is true, the file is read and validated, but not put into service.
+ * Every error found is logged with its line number, along with the pool usage.
+ *
+ * Returns true if the new configuration was valid.
+ */
+
+bool Config_RW::reload(bool check_only) {
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+
+	if(this->_reload_in_progress) {
+		osMutexRelease(this->_lock);
+		LOG_WARN(TAG, "Reload already in progress");
+		return false;
+	}
+
+	/* Find the generation which isn't current */
+	Config_Generation_Type *spare = NULL;
+	for(uint32_t index = 0; index < NUM_CONFIG_GENERATIONS; index++) {
+		if(&this->_generations[index] != this->_current) {
+			spare = &this->_generations[index];
+			break;
+		}
+	}
+
+	if(spare->ref_count) {
+		osMutexRelease(this->_lock);
+		LOG_WARN(TAG, "Generation %u still referenced by %u call(s), try again later", spare->number, spare->ref_count);
+		return false;
+	}
+
+	uint32_t number = this->_current->number + 1;
+	this->_reload_in_progress = true;
+
+	osMutexRelease(this->_lock); /* Release the lock */
+
+	/*
+	 * The spare generation isn't visible to anyone else,
+	 * so the lock isn't held while reading and validating.
+	 */
+
+	bool res = this->_load(spare);
+	if(res) {
+		res = this->_validate(spare);
+		if(!res) {
+			LOG_ERROR(TAG, "Found %u error(s), configuration not changed", this->_error_count);
+		}
+	}
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+
+	if(check_only) {
+		if(res) {
+			LOG_INFO(TAG, "Configuration check passed");
+		}
+		this->_log_usage(spare);
+	}
+	else if(res) {
+		/* Switch new calls over to the new generation */
+		spare->number = number;
+		this->_current = spare;
+		LOG_INFO(TAG, "Configuration generation %u is now in service", number);
+		this->_log_usage(spare);
+	}
+	this->_reload_in_progress = false;
+
+	osMutexRelease(this->_lock); /* Release the lock */
+
+	/* Load any audio samples added by the new configuration */
+	if(res && !check_only) {
+		this->start_prefetch();
+	}
+
+	return res;
+}
+
+/*
+ * Acquire a reference to the current generation
+ *
+ * The generation remains valid until release() is called.
+ */
+
+Config_Generation_Type *Config_RW::acquire(void) {
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+
+	Config_Generation_Type *gen = this->_current;
+	gen->ref_count++;
+
+	osMutexRelease(this->_lock); /* Release the lock */
+
+	return gen;
+}
+
+/*
+ * Release a reference to a generation
+ */
+
+void Config_RW::release(Config_Generation_Type *gen) {
+
+	if(!gen) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+
+	if(!gen->ref_count) {
+		POST_ERROR(Err_Handler::EH_INVP);
+	}
+	gen->ref_count--;
+
+	osMutexRelease(this->_lock); /* Release the lock */
+}
+
+/*
+ * Return the number of the generation currently in service
+ */
+
+uint32_t Config_RW::get_generation_number(void) {
+	return this->_current->number;
+}
+
 /*
  * Get a value from the node tree
  *
@@ -1117,7 +1679,7 @@ const char *Config_RW::get_value(const char *section, const char *key, uint32_t
 		POST_ERROR(Err_Handler::EH_NPFA);
 	}
 
-	for(section_data = this->_section_head; (section_data); section_data = section_data->next) {
+	for(section_data = this->_current->section_head; (section_data); section_data = section_data->next) {
 		if(!strcmp(section_data->section, section)) {
 			break;
 		}
@@ -1150,15 +1712,17 @@ const char *Config_RW::get_value(const char *section, const char *key, uint32_t
  * The callback argument has a default type of NULL. If not supplied,
  * then this function will only test for the existence of the section
  * and nothing else and return true of the section exists, or false if not.
+ *
+ * If gen is NULL, the current generation is traversed.
  */
 
-bool Config_RW::traverse_nodes(const char *section, Traverse_Nodes_Callback_Type callback, void *data) {
+bool Config_RW::traverse_nodes(const char *section, Traverse_Nodes_Callback_Type callback, void *data, Config_Generation_Type *gen) {
 
 	if(!section) {
 		POST_ERROR(Err_Handler::EH_NPFA);
 	}
 	/* Attempt to find the section */
-	Config_Section_Type *section_data = this->_section_head;
+	Config_Section_Type *section_data = this->_tree(gen)->section_head;
 
 	while(section_data) {
 		if(!strcmp(section, section_data->section)) {
@@ -1193,7 +1757,10 @@ bool Config_RW::traverse_nodes(const char *section, Traverse_Nodes_Callback_Type
 }
 
 /*
- * Print syntax error message and panic
+ * Print syntax error message
+ *
+ * The error is counted and the caller must skip the offending line,
+ * so that all errors in the file are reported.
  */
 
 void Config_RW::syntax_error(uint32_t line_num, const char *message) {
@@ -1203,7 +1770,7 @@ void Config_RW::syntax_error(uint32_t line_num, const char *message) {
 	else {
 		LOG_ERROR(TAG," Syntax error on line %u: %s", line_num, message);
 	}
-	POST_ERROR(Err_Handler::EH_CFSE);
+	this->_error_count++;
 }
 
 
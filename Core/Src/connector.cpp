@@ -11,6 +11,7 @@
 #include "drv_dtmf.h"
 #include "sub_line.h"
 #include "trunk.h"
+#include "resource_mgr.h"
 
 
 
@@ -114,12 +115,117 @@ void Connector::prepare(Conn_Info *conn_info, uint32_t source_equip_type, uint32
 	/* Reset the pointer to the peer */
 	conn_info->peer = NULL;
 
+	/* Drop the configuration generation used by a previous call */
+	this->release_config(conn_info);
+
 	/* Configure initial routing info */
 	Utility.memset(&conn_info->route_info, 0, sizeof(conn_info->route_info));
 	conn_info->route_info.state = ROUTE_INDETERMINATE;
 	conn_info->route_info.source_equip_type = source_equip_type;
 	conn_info->route_info.source_phys_line_number = source_phys_line_number;
 	conn_info->route_info.trunk_prefix = NULL;
+	conn_info->cut_through = CT_NONE;
+}
+
+
+/*
+ * Release the configuration generation referenced by a connection
+ *
+ * Called by line or trunk objects when a call ends.
+ */
+
+void Connector::release_config(Conn_Info *conn_info) {
+	if(!conn_info) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	if(conn_info->route_info.config_gen) {
+		Config_rw.release(conn_info->route_info.config_gen);
+		conn_info->route_info.config_gen = NULL;
+	}
+}
+
+
+/*
+ * Fill in the route info for a trunk group destination
+ *
+ * Can be called more than once during a call. The trunk table is rebuilt and
+ * the dialed digits are replaced each time.
+ */
+
+void Connector::_set_trunk_destination(Route_Info *route_info, Config_RW::Config_Section_Type *tg_section, const char *dialed_digits) {
+	Util::Str_Span_Type substrings[MAX_PHYS_LINE_TRUNK_TABLE];
+	char section_name[Config_RW::MAX_SECTION + 1];
+
+	if((!route_info) || (!tg_section) || (!dialed_digits)) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	route_info->dest_equip_type = ET_TRUNK;
+	/* Destination section points to trunk group */
+	route_info->dest_section = tg_section;
+
+	/* Look up mandatory key first */
+	Config_RW::Config_Node_Type *tl_node = Config_rw.find_node("trunk_list", tg_section->head);
+	if(!tl_node) {
+		POST_ERROR(Err_Handler::EH_INVR);
+	}
+	/* Split into substrings to get trunk sections */
+	uint32_t substring_count = Utility.split(tl_node->value, substrings, MAX_PHYS_LINE_TRUNK_TABLE, ',');
+	/* Look up all physical trunks and add their info to the route table */
+	route_info->dest_line_trunk_count = 0;
+	for(uint32_t i = 0; i < substring_count; i++) {
+		Utility.span_copy(section_name, substrings[i], sizeof(section_name));
+		/* Resolved through the path cache, as every call to the trunk group looks these up */
+		Config_RW::Config_Node_Type *pt_node = Config_rw.find_node_by_path(section_name, "phys_trunk", route_info->config_gen);
+		if(!pt_node) {
+			POST_ERROR(Err_Handler::EH_INVR);
+		}
+		/* Convert value from char * to number */
+		unsigned dest_phys_trunk_num;
+		if(!Utility.parse_unsigned(pt_node->value, dest_phys_trunk_num)) {
+			POST_ERROR(Err_Handler::EH_IPLN);
+		}
+		/* Add the physical trunk number to the destination trunk table */
+		route_info->dest_phys_lines_trunks[route_info->dest_line_trunk_count] = (uint8_t) dest_phys_trunk_num;
+		/* Increment the destination trunk count */
+		route_info->dest_line_trunk_count++;
+	}
+	/* Copy dialed digits for reference later */
+	Utility.strncpy_term(route_info->dialed_number, dialed_digits, sizeof(route_info->dialed_number));
+
+	/* Look up the optional start_index key */
+	Config_RW::Config_Node_Type *si_node = Config_rw.find_node("start_index", tg_section->head);
+	/* If found */
+	if(si_node) {
+		unsigned start_index;
+		if(!Utility.parse_unsigned(si_node->value, start_index)) {
+			POST_ERROR(Err_Handler::EH_IPLN);
+		}
+		route_info->dest_dial_start_index = (uint8_t) start_index;
+	}
+	/* Look up the optional prefix string pointer and add it to the route info */
+	Config_RW::Config_Node_Type *prefix_node = Config_rw.find_node("prefix", tg_section->head);
+	if(prefix_node) {
+		route_info->trunk_prefix = prefix_node->value;
+	}
+}
+
+
+/*
+ * Send a seize message to the first line or trunk in the route info
+ *
+ * Returns the peer message result PMR_*
+ */
+
+uint32_t Connector::_seize_first_dest(Conn_Info *conn_info) {
+	conn_info->trunk_index = 0; /* Select the first trunk */
+	/* Try to seize it */
+	return this->send_peer_message(
+			conn_info,
+			conn_info->route_info.dest_equip_type,
+			conn_info->route_info.dest_phys_lines_trunks[conn_info->trunk_index],
+			PM_SEIZE);
 }
 
 
@@ -147,22 +253,25 @@ uint32_t Connector::test(Conn_Info *conn_info, const char *dialed_digits) {
 
 	uint32_t res = ROUTE_INDETERMINATE;
 
-	/* Allocate a working string */
-	char *alloc_str = Utility.allocate_long_string();
 	/* The first time this is called, we need to compute a pointer to the routing table. */
 	/* Once this is done, subsequent calls will use the computed pointer. */
 	if(!route_info->rt_head) {
+		/* The call uses the same configuration generation until it ends */
+		if(!route_info->config_gen) {
+			route_info->config_gen = Config_rw.acquire();
+		}
 		/* Locate the routing table */
-		unsigned pltn = route_info->source_phys_line_number;
-		const char *start_section;
-		snprintf(alloc_str, Util::LONG_STRINGS_SIZE, "%u/routing_table", pltn);
+		/* The path is resolved through the configuration path cache */
+		char path[Config_RW::MAX_CACHED_PATH + 1];
+		const char *start_section = NULL;
+		snprintf(path, sizeof(path), "%u/routing_table", (unsigned) route_info->source_phys_line_number);
 		switch(route_info->source_equip_type) {
 		case ET_LINE:
-			start_section="subscribers";
+			start_section = "subscribers";
 			break;
 
 		case ET_TRUNK:
-			start_section="incoming_trunks";
+			start_section = "incoming_trunks";
 			break;
 
 		default:
@@ -171,7 +280,7 @@ uint32_t Connector::test(Conn_Info *conn_info, const char *dialed_digits) {
 		}
 
 		/* Get the node with the routing table information */
-		route_info->rt_head = Config_rw.find_node_by_path(start_section, alloc_str);
+		route_info->rt_head = Config_rw.find_node_by_path(start_section, path, route_info->config_gen);
 
 		if(!route_info->rt_head) {
 			/* Configuration invalid after being validated at boot up */
@@ -180,14 +289,11 @@ uint32_t Connector::test(Conn_Info *conn_info, const char *dialed_digits) {
 		}
 	}
 
-	/* Deallocate working string */
-	Utility.deallocate_long_string(alloc_str);
-
 	/* At this point, we have a pointer to the routing table node */
 	/* We now need to test the dialed digits against what is held in the routing table */
 
 	/* Retrieve the route table section header */
-	Config_RW::Config_Section_Type *route_table = Config_rw.find_section(route_info->rt_head->value);
+	Config_RW::Config_Section_Type *route_table = Config_rw.find_section(route_info->rt_head->value, route_info->config_gen);
 	if(!route_table) {
 		POST_ERROR(Err_Handler::EH_BRV);
 	}
@@ -209,10 +315,10 @@ uint32_t Connector::test(Conn_Info *conn_info, const char *dialed_digits) {
 	route_info->state = (uint8_t) res;
 	if(res == ROUTE_VALID) {
 		/* Retrieve the destination information from the route */
-		uint32_t substring_count = 3;
-		char *substrings[3];
+		Util::Str_Span_Type substrings[3];
+		char section_name[Config_RW::MAX_SECTION + 1];
 		/* Split value on comma */
-		char *alloc_str = Utility.str_split(node->value, substrings, substring_count, ',');
+		uint32_t substring_count = Utility.split(node->value, substrings, 3, ',');
 		if(substring_count != 2) {
 			POST_ERROR(Err_Handler::EH_INVR);
 		}
@@ -220,7 +326,7 @@ uint32_t Connector::test(Conn_Info *conn_info, const char *dialed_digits) {
 		/* Second string is the physical line node for lines or */
 		/* a trunk group for trunks */
 		static const char *routing_keywords[] = {"sub", "tg", NULL};
-		switch(Utility.keyword_match(substrings[0], routing_keywords)) {
+		switch(Utility.span_keyword_match(substrings[0], routing_keywords)) {
 		case 0:
 			route_info->dest_equip_type = ET_LINE;
 			break;
@@ -237,25 +343,24 @@ uint32_t Connector::test(Conn_Info *conn_info, const char *dialed_digits) {
 
 		/* Act on destination line/trunk choice */
 
+		Utility.span_copy(section_name, substrings[1], sizeof(section_name));
+
 		if(route_info->dest_equip_type == ET_LINE) {
 			/* Look up the destination line info section head*/
-			Config_RW::Config_Section_Type *dl_section = Config_rw.find_section(substrings[1]);
+			Config_RW::Config_Section_Type *dl_section = Config_rw.find_section(section_name, route_info->config_gen);
 			if(!dl_section) {
 				POST_ERROR(Err_Handler::EH_BRV);
 			}
 			/* Destination section points to destination line */
 			route_info->dest_section = dl_section;
 
-			/* Deallocate working string */
-			Utility.deallocate_long_string(alloc_str);
-
 			/* Locate the physical line number for the destination */
 			Config_RW::Config_Node_Type *dl_node = Config_rw.find_node("phys_line", dl_section->head);
 			if(!dl_node) {
 				POST_ERROR(Err_Handler::EH_BRV);
 			}
 			unsigned dest_phys_line_num;
-			if(sscanf(dl_node->value, "%u", &dest_phys_line_num) != 1) {
+			if(!Utility.parse_unsigned(dl_node->value, dest_phys_line_num)) {
 				POST_ERROR(Err_Handler::EH_IPLN);
 			}
 			/* Update the routing info with the destination information */
@@ -267,67 +372,12 @@ uint32_t Connector::test(Conn_Info *conn_info, const char *dialed_digits) {
 		}
 		else if(route_info->dest_equip_type == ET_TRUNK) {
 			/* Look up the trunk group */
-			Config_RW::Config_Section_Type *tg_section = Config_rw.find_section(substrings[1]);
+			Config_RW::Config_Section_Type *tg_section = Config_rw.find_section(section_name, route_info->config_gen);
 			if(!tg_section) {
 				POST_ERROR(Err_Handler::EH_BRV);
 			}
-			/* Destination section points to trunk group */
-			route_info->dest_section = tg_section;
-			/* Deallocate working string */
-			Utility.deallocate_long_string(alloc_str);
-
-			/* Look up mandatory key first */
-			Config_RW::Config_Node_Type *tl_node = Config_rw.find_node("trunk_list", tg_section->head);
-			if(!tl_node) {
-				POST_ERROR(Err_Handler::EH_INVR);
-			}
-			/* Split into substrings to get trunk sections */
-			substring_count = 3;
-			char *alloc_str = Utility.str_split(tl_node->value, substrings, substring_count, ',');
-			/* Look up all physical trunks and add their info to the route table */
-			for(uint32_t i = 0; i < substring_count; i++) {
-				Config_RW::Config_Section_Type *pt_section = Config_rw.find_section(substrings[i]);
-				if(!pt_section) {
-					POST_ERROR(Err_Handler::EH_BRV);
-				}
-				Config_RW::Config_Node_Type *pt_node = Config_rw.find_node("phys_trunk", pt_section->head);
-				if(!pt_node) {
-					POST_ERROR(Err_Handler::EH_INVR);
-				}
-				/* Convert value from char * to number */
-				unsigned dest_phys_trunk_num;
-				if(sscanf(pt_node->value, "%u", &dest_phys_trunk_num) != 1) {
-					POST_ERROR(Err_Handler::EH_IPLN);
-				}
-				/* Add the physical trunk number to the destination trunk table */
-				route_info->dest_phys_lines_trunks[route_info->dest_line_trunk_count] = (uint8_t) dest_phys_trunk_num;
-				/* Increment the destination trunk count */
-				route_info->dest_line_trunk_count++;
-				/* Copy dialed digits for reference later if they weren't stored previously */
-				if(!route_info->dialed_number[0]) {
-					Utility.strncpy_term(route_info->dialed_number, dialed_digits, sizeof(route_info->dialed_number));
-				}
-
-
-			}
-			/* Look up the optional start_index key */
-			Config_RW::Config_Node_Type *si_node = Config_rw.find_node("start_index", tg_section->head);
-			/* If found */
-			if(si_node) {
-				unsigned start_index;
-				if(sscanf(si_node->value, "%u", &start_index) != 1) {
-					POST_ERROR(Err_Handler::EH_IPLN);
-				}
-				route_info->dest_dial_start_index = (uint8_t) start_index;
-			}
-			/* Look up the optional prefix string pointer and add it to the route info */
-			Config_RW::Config_Node_Type *prefix_node = Config_rw.find_node("prefix", tg_section->head);
-			if(prefix_node) {
-				route_info->trunk_prefix = prefix_node->value;
-			}
-
-			/* Deallocate working string */
-			Utility.deallocate_long_string(alloc_str);
+			/* Add the trunks in the group and their dialing options to the route info */
+			this->_set_trunk_destination(route_info, tg_section, dialed_digits);
 
 			LOG_DEBUG(TAG, "Route table updated for trunk destination");
 		}
@@ -367,13 +417,8 @@ uint32_t Connector::resolve(Conn_Info *conn_info) {
 	}
 	uint32_t res = ROUTE_DEST_CONNECTED;
 
-	conn_info->trunk_index = 0; /* Select the first trunk */
-	/* Try to seize it */
-	uint32_t pm_res = this->send_peer_message(
-			conn_info,
-			conn_info->route_info.dest_equip_type,
-			conn_info->route_info.dest_phys_lines_trunks[conn_info->trunk_index],
-			PM_SEIZE);
+	/* Try to seize the first line or trunk */
+	uint32_t pm_res = this->_seize_first_dest(conn_info);
 	/* Set the result for the caller */
 	switch(pm_res) {
 	case PMR_OK:
@@ -456,6 +501,129 @@ uint32_t Connector::resolve_try_next_trunk(Conn_Info *conn_info) {
 }
 
 
+/*
+ * Cut-through dialing.
+ *
+ * Called by a line while the route is still indeterminate. If every routing table entry the
+ * digits dialed so far could still match sends the call to the same trunk group, and the trunk group
+ * has cut_through enabled, the first trunk in the group is seized now so the wink arrives while
+ * the caller is still dialing. The address is sent when the route becomes valid.
+ *
+ * Returns true if a seizure was attempted. The result is kept in conn_info->cut_through.
+ */
+
+bool Connector::seize_trunk_early(Conn_Info *conn_info, const char *dialed_digits) {
+
+	if((!dialed_digits) || (!conn_info)) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	Route_Info *route_info = &conn_info->route_info;
+
+	/* Only try once per call, and only after test() has located the routing table */
+	if((conn_info->cut_through != CT_NONE) || (route_info->state != ROUTE_INDETERMINATE) || (!route_info->rt_head)) {
+		return false;
+	}
+
+	Config_RW::Config_Section_Type *route_table = Config_rw.find_section(route_info->rt_head->value, route_info->config_gen);
+	if(!route_table) {
+		POST_ERROR(Err_Handler::EH_BRV);
+	}
+
+	/* Find the destination of the routes which can still match */
+	uint32_t dialed_length = strlen(dialed_digits);
+	const char *dest = NULL;
+	for(Config_RW::Config_Node_Type *node = route_table->head; node; node = node->next) {
+		if(this->_test_against_route(dialed_digits, node->key) == ROUTE_INVALID) {
+			continue;
+		}
+		/* Entries shorter than the digits dialed can never match */
+		uint32_t entry_length = strlen(node->key);
+		if(node->key[0] == '_') {
+			entry_length--;
+		}
+		if(entry_length < dialed_length) {
+			continue;
+		}
+		if(!dest) {
+			dest = node->value;
+		}
+		else if(strcmp(dest, node->value)) {
+			/* More than one destination is still possible */
+			return false;
+		}
+	}
+	if(!dest) {
+		return false;
+	}
+
+	/* The destination must be a trunk group */
+	Util::Str_Span_Type substrings[3];
+	char section_name[Config_RW::MAX_SECTION + 1];
+	static const char *routing_keywords[] = {"tg", NULL};
+	if(Utility.split(dest, substrings, 3, ',') != 2) {
+		POST_ERROR(Err_Handler::EH_INVR);
+	}
+	if(Utility.span_keyword_match(substrings[0], routing_keywords) != 0) {
+		return false;
+	}
+	Utility.span_copy(section_name, substrings[1], sizeof(section_name));
+	Config_RW::Config_Section_Type *tg_section = Config_rw.find_section(section_name, route_info->config_gen);
+	if(!tg_section) {
+		POST_ERROR(Err_Handler::EH_BRV);
+	}
+
+	/* Cut-through must be enabled on the trunk group. */
+	/* The far end may time out if it has to wait too long for the address */
+	static const char *yes_no_keywords[] = {"yes", "no", NULL};
+	Config_RW::Config_Node_Type *ct_node = Config_rw.find_node("cut_through", tg_section->head);
+	if((!ct_node) || (Utility.keyword_match(ct_node->value, yes_no_keywords) != 0)) {
+		return false;
+	}
+
+	/* Set up the trunk destination with the digits dialed so far. */
+	/* Test() replaces them once the route is valid. The route state stays indeterminate */
+	this->_set_trunk_destination(route_info, tg_section, dialed_digits);
+
+	switch(this->_seize_first_dest(conn_info)) {
+	case PMR_OK:
+		LOG_DEBUG(TAG, "Cut-through seizure of trunk %u after %s", this->get_called_phys_line_trunk(conn_info), dialed_digits);
+		conn_info->cut_through = CT_SEIZED;
+		break;
+
+	case PMR_TRUNK_BUSY:
+		/* Let the caller advance to the next trunk once the route is valid */
+		conn_info->cut_through = CT_FAILED;
+		break;
+
+	default:
+		POST_ERROR(Err_Handler::EH_BRV);
+		break;
+	}
+
+	return true;
+}
+
+
+/*
+ * Release a trunk seized for cut-through dialing which is no longer needed
+ *
+ * Called by a line when the call fails before the address has been sent
+ */
+
+void Connector::cancel_cut_through(Conn_Info *conn_info) {
+	if(!conn_info) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	/* A trunk which failed releases itself */
+	if((conn_info->cut_through == CT_SEIZED) || (conn_info->cut_through == CT_READY)) {
+		this->send_message_to_dest(conn_info, PM_RELEASE);
+	}
+	conn_info->cut_through = CT_NONE;
+}
+
+
 /*
  * Send message to called destination
  * For use by lines and trunks only in the event process.
@@ -722,9 +890,29 @@ void Connector::release_tone_generator(Conn_Info *info) {
 }
 
 
+/*
+ * Seize a tone generator for a line or trunk part way through a call.
+ *
+ * It is reserved through the resource manager, so it takes its turn behind queued waiters.
+ * Returns the descriptor, or -1 if none is free yet. The line or trunk is then queued,
+ * and woken when one has been reserved for it.
+ */
+
+int32_t Connector::seize_tone_generator(Conn_Info *info) {
+	if(!this->reserve_resources(info, Resource_Mgr::RM_TONE_CHANNEL, Resource_Mgr::RP_NORMAL)) {
+		return -1;
+	}
+	int32_t descriptor = Tone_plant.channel_seize(this->claim_resource(info, Resource_Mgr::RT_TONE_CHANNEL), info);
+	if(descriptor < 0) {
+		LOG_WARN(TAG, "Reserved tone generator could not be seized");
+		Resource_mgr.release_owned(info);
+	}
+	return descriptor;
+}
+
 /*
  * Seize and connect a tone generator.
- * Return true if successful, or false if no generator is available.
+ * Return true if successful, or false if no generator is available yet.
  *
  * Note: Will disconnect and reconnect if a tone plant was previously connected.
  */
@@ -738,14 +926,146 @@ bool Connector::seize_and_connect_tone_generator(Conn_Info *info, bool orig_term
 		POST_ERROR(Err_Handler::EH_NPFA);
 	}
 
+	/* Batch the disconnect and reconnect so switches which don't change aren't touched */
+	Xps_logical.begin();
 	Conn.release_tone_generator(info);
 
-	info->tone_plant_descriptor = Tone_plant.channel_seize();
-	if(info->tone_plant_descriptor == -1) {
-		return false;
+	info->tone_plant_descriptor = this->seize_tone_generator(info);
+	if(info->tone_plant_descriptor != -1) {
+		Xps_logical.connect_tone_plant_output(&info->jinfo, info->tone_plant_descriptor, orig_term);
+	}
+	Xps_logical.commit();
+
+	return (info->tone_plant_descriptor != -1);
+}
+
+/*
+ * Resource manager grant callback
+ */
+
+static void __resources_granted_callback(void *data) {
+	Conn.resources_granted((Conn_Info *) data);
+}
+
+/*
+ * Initialize the resource reservation fields of a line or trunk
+ */
+
+void Connector::init_resources(Conn_Info *info) {
+	if(!info) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+	info->resource_wait = false;
+	for(uint32_t type = 0; type < Resource_Mgr::NUM_RESOURCE_TYPES; type++) {
+		info->resources.index[type] = -1;
+	}
+}
+
+/*
+ * Reserve the junctor, tone generator and receivers a line or trunk needs to set up a call, all at once.
+ *
+ * Returns true when the whole set is reserved. Each one is then taken with claim_resource() and
+ * seized with the seize method of the owning module. If they aren't all free, nothing is held,
+ * the line or trunk is queued, false is returned, and it will be woken when the set has been reserved.
+ * The next call then collects the set from the resource manager.
+ */
+
+bool Connector::reserve_resources(Conn_Info *info, uint32_t type_mask, uint32_t priority) {
+	if(!info) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	if(Resource_mgr.reserve(type_mask, info->resources, __resources_granted_callback, info, priority)) {
+		info->resource_wait = false;
+		return true;
+	}
+	info->resource_wait = true; /* Queued, or still waiting */
+	return false;
+}
+
+/*
+ * Take a reserved resource out of the set. Returns its index for the seize method of the owning module,
+ * which must be passed info as the owner.
+ */
+
+int32_t Connector::claim_resource(Conn_Info *info, uint32_t type) {
+	if(!info) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+	if((type >= Resource_Mgr::NUM_RESOURCE_TYPES) || (info->resources.index[type] < 0)) {
+		POST_ERROR(Err_Handler::EH_INVR);
+	}
+	int32_t index = info->resources.index[type];
+	info->resources.index[type] = -1;
+	return index;
+}
+
+/*
+ * Leave the resource manager queue, and release anything reserved but not yet claimed
+ */
+
+void Connector::release_resources(Conn_Info *info) {
+	if(!info) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	if(info->resource_wait) {
+		/* This also releases a set which was reserved for it but not collected */
+		if(Resource_mgr.cancel_wait(info)) {
+			LOG_DEBUG(TAG, "Uncollected resources released");
+		}
+		info->resource_wait = false;
+	}
+	Resource_mgr.release_reserved(info->resources);
+}
+
+/*
+ * Called when a reserved resource couldn't be seized while setting up a call.
+ *
+ * Releases everything reserved or seized so far, so the set can be reserved again from the start.
+ * Nothing has been connected to the junctor yet.
+ */
+
+void Connector::abandon_resources(Conn_Info *info) {
+	if(!info) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	LOG_WARN(TAG, "Reserved resource could not be seized, reserving again");
+	this->release_resources(info);
+	/* What was claimed but not seized is still reserved for this line or trunk */
+	Resource_mgr.release_owned(info);
+	if(info->tone_plant_descriptor != -1) {
+		Tone_plant.channel_release(info->tone_plant_descriptor);
+		info->tone_plant_descriptor = -1;
+	}
+	if(info->dtmf_receiver_descriptor != -1) {
+		Dtmf_receivers.release(info->dtmf_receiver_descriptor);
+		info->dtmf_receiver_descriptor = -1;
+	}
+	if(info->mf_receiver_descriptor != -1) {
+		MF_decoder.release(info->mf_receiver_descriptor);
+		info->mf_receiver_descriptor = -1;
+	}
+	if(info->junctor_seized) {
+		Xps_logical.release(&info->jinfo);
+		info->junctor_seized = false;
+	}
+}
+
+/*
+ * Called by the resource manager when the resources a waiting line or trunk asked for were reserved.
+ *
+ * The set is kept by the resource manager until the line or trunk collects it, so this only wakes it.
+ */
+
+void Connector::resources_granted(Conn_Info *info) {
+	if(info->equip_type == ET_LINE) {
+		Sub_line.wake(info->phys_line_trunk_number);
+	}
+	else if(info->equip_type == ET_TRUNK) {
+		Trunks.wake(info->phys_line_trunk_number);
 	}
-	Xps_logical.connect_tone_plant_output(&info->jinfo, info->tone_plant_descriptor, orig_term);
-	return true;
 }
 
 /*
@@ -18,6 +18,10 @@
 #include "sub_line.h"
 #include "trunk.h"
 #include "hw_pres.h"
+#include "config_rw.h"
+#include "card_comm.h"
+#include "i2c_engine.h"
+#include "resource_mgr.h"
 
 const char *TAG = "console";
 
@@ -48,6 +52,12 @@ static bool command_mfr_release(Holder_Type *vars, uint32_t *error_code);
 static bool command_dtmfr_seize(Holder_Type *vars, uint32_t *error_code);
 static bool command_dtmfr_release(Holder_Type *vars, uint32_t *error_code);
 static bool command_config_hw_view_present(Holder_Type *vars, uint32_t *error_code);
+static bool command_config_hw_view_atten(Holder_Type *vars, uint32_t *error_code);
+static bool command_config_hw_view_i2c(Holder_Type *vars, uint32_t *error_code);
+static bool command_config_hw_view_resources(Holder_Type *vars, uint32_t *error_code);
+static bool command_config_reload(Holder_Type *vars, uint32_t *error_code);
+static bool command_config_check(Holder_Type *vars, uint32_t *error_code);
+static bool command_config_view_cache(Holder_Type *vars, uint32_t *error_code);
 static bool command_help(Holder_Type *vars, uint32_t *error_code);
 static bool command_trunk_offline(Holder_Type *vars, uint32_t *error_code);
 static bool command_trunk_online(Holder_Type *vars, uint32_t *error_code);
@@ -121,18 +131,24 @@ const Command_Table_Entry_Type test_xps_level[] = {
 };
 
 const Command_Table_Entry_Type config_view_hw_level[] = {
+		{NULL, command_config_hw_view_atten, NULL, "atten" },
+		{NULL, command_config_hw_view_i2c, NULL, "i2c" },
 		{NULL, command_config_hw_view_present, NULL, "present" },
+		{NULL, command_config_hw_view_resources, NULL, "resources" },
 
 		{NULL, NULL, NULL, ""}
 };
 
 const Command_Table_Entry_Type config_view_level[] = {
+		{NULL, command_config_view_cache, NULL, "cache"},
 		{config_view_hw_level, NULL, NULL, "hw"},
 
 		{NULL, NULL, NULL, ""}
 };
 
 const Command_Table_Entry_Type config_level[] = {
+		{NULL, command_config_check, NULL, "check"},
+		{NULL, command_config_reload, NULL, "reload"},
 		{config_view_level, NULL, NULL, "view"},
 
 		{NULL, NULL, NULL, ""}
@@ -158,6 +174,8 @@ const char *console_error_strings[] = {
 	{"No resource"},
 	{"Resource already allocated"},
 	{"Trunk not present, or in use"},
+	{"Configuration not reloaded, see log"},
+	{"Configuration has errors, see log"},
 
 	{"Unknown Error"}
 };
@@ -275,7 +293,7 @@ static bool command_xps_open(Holder_Type *vars, uint32_t *error_code) {
 	}
 	else {
 		/* Validate parameters */
-		if((x >= 32) || (y >= 8)) {
+		if((x >= Xps_logical.get_num_x()) || (y >= XPS_Logical::LOGICAL_NUM_Y)) {
 			res = false;
 			*error_code = CEC_PARAM_OUT_OF_RANGE;
 
@@ -311,7 +329,7 @@ static bool command_xps_close(Holder_Type *vars, uint32_t *error_code) {
 	}
 	else {
 		/* Validate parameters */
-		if((x >= 32) || (y >= 8)) {
+		if((x >= Xps_logical.get_num_x()) || (y >= XPS_Logical::LOGICAL_NUM_Y)) {
 			res = false;
 			*error_code = CEC_PARAM_OUT_OF_RANGE;
 
@@ -343,25 +361,24 @@ static bool command_xps_status(Holder_Type *vars, uint32_t *error_code) {
 	unsigned x,y;
 
 	/* Print Matrix */
-	for(y = 0; y < 8; y++) {
+	unsigned num_x = Xps_logical.get_num_x();
+	for(y = 0; y < XPS_Logical::LOGICAL_NUM_Y; y++) {
 		if((y & 1) == 0) {
 			printf("\n"); /* Print blank line between pairs */
 		}
 		printf("%u ", y);
-		for(x = 0; x < 32; x++) {
+		for(x = 0; x < num_x; x++) {
 			if(Xps_logical.get_switch_state(x,y)) {
 				printf("X"); /* Connected */
 			}
 			else {
 				printf("0"); /* Disconnected */
 			}
-			if(x == 15) {
+			if((x % XPS_Logical::PHYSICAL_NUM_X) == (XPS_Logical::PHYSICAL_NUM_X - 1)) {
 				printf(" "); /* Print a space between groups of 16 X values */
 			}
-			if(x == 31) {
-				printf("\n"); /* Print a newline at the end */
-			}
 		}
+		printf("\n"); /* Print a newline at the end */
 	}
 
 	return true;
@@ -612,6 +629,115 @@ static bool command_config_hw_view_present(Holder_Type *vars, uint32_t *error_co
 }
 
 
+/*
+ * Reload the switch configuration file
+ */
+
+static bool command_config_reload(Holder_Type *vars, uint32_t *error_code) {
+
+	if(!Config_rw.reload()) {
+		*error_code = CEC_CONFIG_NOT_RELOADED;
+		return false;
+	}
+
+	printf("Configuration generation %u in service\n", (unsigned) Config_rw.get_generation_number());
+
+	return true;
+}
+
+/*
+ * Check the switch configuration file without putting it into service
+ */
+
+static bool command_config_check(Holder_Type *vars, uint32_t *error_code) {
+
+	if(!Config_rw.reload(true)) {
+		*error_code = CEC_CONFIG_ERRORS;
+		return false;
+	}
+
+	printf("No errors found\n");
+
+	return true;
+}
+
+/*
+ * Display configuration path cache statistics
+ */
+
+/*
+ * Show the card attention to event handler latency statistics
+ */
+
+static bool command_config_hw_view_atten(Holder_Type *vars, uint32_t *error_code) {
+	Card_Comm::Atten_Stats_Type stats;
+
+	printf("\n*** Attention Latency (ms) ***\n");
+	printf("Card Events    Failures Average Max\n");
+	for(uint32_t card = 0; card < Atten::MAX_NUM_CARDS; card++) {
+		Card_comm.get_atten_stats(card, stats);
+		unsigned average = (stats.events) ? (unsigned) (stats.total_latency / stats.events) : 0;
+		printf("%-4u %-9u %-8u %-7u %u\n", (unsigned) card, (unsigned) stats.events, (unsigned) stats.failures,
+				average, (unsigned) stats.max_latency);
+	}
+
+	return true;
+}
+
+/*
+ * Show the I2C transaction queue statistics
+ */
+
+static bool command_config_hw_view_i2c(Holder_Type *vars, uint32_t *error_code) {
+	static const char *priority_names[I2C_Engine::NUM_I2C_PRIORITIES] = {"High", "Normal"};
+	I2C_Engine::I2C_Queue_Stats stats;
+
+	printf("\n*** I2C Queues (times in ms) ***\n");
+	printf("Bus Priority Queued    Max depth Avg wait Max wait Missed\n");
+	for(uint32_t bus = 0; bus < I2C_Engine::NUM_I2C_BUSSES; bus++) {
+		for(uint32_t priority = 0; priority < I2C_Engine::NUM_I2C_PRIORITIES; priority++) {
+			I2c.get_queue_stats(bus, priority, stats);
+			unsigned average = (stats.queued) ? (unsigned) (stats.total_wait / stats.queued) : 0;
+			printf("%-3u %-8s %-9u %-9u %-8u %-8u %u\n", (unsigned) bus, priority_names[priority], (unsigned) stats.queued,
+					(unsigned) stats.max_depth, average, (unsigned) stats.max_wait, (unsigned) stats.deadline_misses);
+		}
+	}
+
+	return true;
+}
+
+static bool command_config_hw_view_resources(Holder_Type *vars, uint32_t *error_code) {
+	static const char *type_names[Resource_Mgr::NUM_RESOURCE_TYPES] = {"Junctor", "Tone", "DTMF rx", "MF rx"};
+	Resource_Mgr::Resource_Stats stats;
+
+	printf("\n*** Resources (times in ms) ***\n");
+	printf("Type     In use Peak   Grants   Failures Waits    Handoffs Waiting Peak Avg wait Max wait\n");
+	for(uint32_t type = 0; type < Resource_Mgr::NUM_RESOURCE_TYPES; type++) {
+		Resource_mgr.get_stats(type, stats);
+		unsigned average = (stats.handoffs) ? (unsigned) (stats.total_wait_time / stats.handoffs) : 0;
+		printf("%-8s %-6u %-6u %-8u %-8u %-8u %-8u %-7u %-4u %-8u %u\n", type_names[type], (unsigned) stats.in_use,
+				(unsigned) stats.peak_in_use, (unsigned) stats.grants, (unsigned) stats.failures, (unsigned) stats.waits,
+				(unsigned) stats.handoffs, (unsigned) stats.waiting, (unsigned) stats.peak_waiting, average, (unsigned) stats.max_wait_time);
+	}
+
+	return true;
+}
+
+static bool command_config_view_cache(Holder_Type *vars, uint32_t *error_code) {
+	uint32_t hits, misses, entries_used;
+
+	Config_rw.get_path_cache_stats(hits, misses, entries_used);
+
+	uint32_t lookups = hits + misses;
+	unsigned hit_rate = (lookups) ? (unsigned) ((hits * 100) / lookups) : 0;
+
+	printf("\n*** Path Cache, Generation %u ***\n", (unsigned) Config_rw.get_generation_number());
+	printf("Entries used: %u of %u\n", (unsigned) entries_used, (unsigned) Config_RW::PATH_CACHE_ENTRIES);
+	printf("Hits: %u Misses: %u Hit rate: %u%%\n", (unsigned) hits, (unsigned) misses, hit_rate);
+
+	return true;
+}
+
 
 /*
  * MF Receiver callback
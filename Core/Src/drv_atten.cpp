@@ -10,7 +10,21 @@ namespace Atten {
 
 static const char *TAG = "drvatten";
 
-static const uint8_t lookup[MAX_NUM_CARDS] = {ATTEN0, ATTEN1, ATTEN2, ATTEN3, ATTEN4, ATTEN5, ATTEN6};
+typedef struct Atten_Pin {
+	GPIO_TypeDef *port;
+	uint16_t pin;
+} Atten_Pin_Type;
+
+/* Cards 0-3 are on one port, and cards 4-6 are on another */
+static const Atten_Pin_Type pins[MAX_NUM_CARDS] = {
+		{ATTEN0_GPIO_Port, ATTEN0_Pin},
+		{ATTEN1_GPIO_Port, ATTEN1_Pin},
+		{ATTEN2_GPIO_Port, ATTEN2_Pin},
+		{ATTEN3_GPIO_Port, ATTEN3_Pin},
+		{ATTEN4_GPIO_Port, ATTEN4_Pin},
+		{ATTEN5_GPIO_Port, ATTEN5_Pin},
+		{ATTEN6_GPIO_Port, ATTEN6_Pin}
+};
 
 bool Atten::get_state(uint32_t card) {
 
@@ -18,8 +32,32 @@ bool Atten::get_state(uint32_t card) {
 		POST_ERROR(Err_Handler::EH_IVCN);
 	}
 
-	return Utility.get_gpio_pin_state(lookup[card]);
+	return HAL_GPIO_ReadPin(pins[card].port, pins[card].pin);
+
+}
+
+/*
+ * Return the attention state of all cards as a bit mask, with bit 0 being card 0.
+ *
+ * Each GPIO port's input data register is read once, so all cards
+ * are sampled at the same time.
+ */
+
+uint32_t Atten::get_snapshot(void) {
+	GPIO_TypeDef *port = NULL;
+	uint32_t port_state = 0;
+	uint32_t res = 0;
 
+	for(uint32_t card = 0; card < MAX_NUM_CARDS; card++) {
+		if(pins[card].port != port) {
+			port = pins[card].port;
+			port_state = port->IDR;
+		}
+		if(port_state & pins[card].pin) {
+			res |= (1 << card);
+		}
+	}
+	return res;
 }
 
 
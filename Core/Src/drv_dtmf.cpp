@@ -3,6 +3,7 @@
 #include "drv_dtmf.h"
 #include "logging.h"
 #include "err_handler.h"
+#include "resource_mgr.h"
 
 
 static const char *TAG = "dtmfdrv";
@@ -152,8 +153,7 @@ void Dtmf::poll(void) {
  * Returns -1 if unsuccessful, else a receiver descriptor.
  */
 
-int32_t Dtmf::seize(Dtmf_Callback callback, uint32_t parameter, int32_t receiver) {
-	int32_t receiver_to_test;
+int32_t Dtmf::seize(Dtmf_Callback callback, uint32_t parameter, int32_t receiver, void *owner) {
 
 	/* Validate receiver number */
 	if((receiver < -1) || (receiver >= NUM_DTMF_RECEIVERS)) {
@@ -167,27 +167,8 @@ int32_t Dtmf::seize(Dtmf_Callback callback, uint32_t parameter, int32_t receiver
 		POST_ERROR(Err_Handler::EH_LAF);
 	}
 
-	if(receiver == -1) {
-		/* Try to find an available receiver */
-		for(receiver_to_test = 0; receiver_to_test < NUM_DTMF_RECEIVERS; receiver_to_test++) {
-			uint32_t receiver_mask_bit = (1 << receiver_to_test);
-			if((this->_siezed_receivers & receiver_mask_bit) == 0) {
-				this->_siezed_receivers |= receiver_mask_bit;
-				receiver = receiver_to_test;
-				break;
-			}
-		}
-	}
-	else {
-		/* Caller is requesting a specific receiver number */
-		uint32_t receiver_mask_bit = (1 << receiver);
-		if((this->_siezed_receivers & receiver_mask_bit) == 0) {
-			this->_siezed_receivers |= receiver_mask_bit ;
-		}
-		else {
-			receiver = -1;
-		}
-	}
+	/* The receiver busy bits are kept by the resource manager */
+	receiver = Resource_mgr.allocate(Resource_Mgr::RT_DTMF_RECEIVER, receiver, owner);
 
 	if(receiver != -1) { /* If successful */
 		this->_parameter[receiver] = parameter;
@@ -219,13 +200,14 @@ void Dtmf::release(int32_t descriptor) {
 	}
 
 	/* Free DTMF receiver */
-	uint32_t decoder_mask_bit = (1 << descriptor);
-	this->_siezed_receivers &= ~decoder_mask_bit;
 	this->_callback[descriptor] = NULL;
 
 
 	/* Release the lock */
 	osMutexRelease(this->_lock);
+
+	/* This may hand the receiver straight to a waiter */
+	Resource_mgr.release(Resource_Mgr::RT_DTMF_RECEIVER, descriptor);
 }
 
 
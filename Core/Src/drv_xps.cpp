@@ -8,26 +8,27 @@ static const char *TAG = "drvxps";
 
 static const uint8_t x_map[16] = {0,1,2,3,4,5,8,9,10,11,12,13,6,7,14,15};
 
+/* Chip select lines indexed by chip number */
+static GPIO_TypeDef * const cs_ports[Xps::MAX_CPS_CHIPS] = {XB_SW_CS0_GPIO_Port, XB_SW_CS1_GPIO_Port, XB_SW_CS2_GPIO_Port};
+static const uint16_t cs_pins[Xps::MAX_CPS_CHIPS] = {XB_SW_CS0_Pin, XB_SW_CS1_Pin, XB_SW_CS2_Pin};
+
 namespace Xps {
 
 /*
- * Set the state of a specific CS line
+ * Return the BSRR value which sets a group of pins to the bits in value
  */
 
-void Xps::_set_cs_state(uint32_t cs_number, bool state) {
-	switch(cs_number) {
-	case 0:
-		Utility.set_gpio_pin_state(XB_SW_CS0, state);
-		break;
-
-	case 1:
-		Utility.set_gpio_pin_state(XB_SW_CS1, state);
-		break;
-
-	default:
-		POST_ERROR(Err_Handler::EH_ICSN);
+static uint32_t _bsrr_value(const uint16_t *pins, uint32_t num_pins, uint32_t value) {
+	uint32_t bsrr = 0;
+	for(uint32_t i = 0; i < num_pins; i++, value >>= 1) {
+		if(value & 1) {
+			bsrr |= pins[i]; /* Set */
+		}
+		else {
+			bsrr |= ((uint32_t) pins[i]) << 16; /* Reset */
+		}
 	}
-
+	return bsrr;
 }
 
 void Xps::init(void) {
@@ -39,6 +40,27 @@ void Xps::init(void) {
 					0U
 				};
 
+	/* The X and Y address lines are on one port so an address can be set with one BSRR write */
+	static GPIO_TypeDef * const addr_ports[] = {XB_SW_X0_GPIO_Port, XB_SW_X1_GPIO_Port, XB_SW_X2_GPIO_Port, XB_SW_X3_GPIO_Port,
+			XB_SW_Y0_GPIO_Port, XB_SW_Y1_GPIO_Port, XB_SW_Y2_GPIO_Port};
+	static const uint16_t x_pins[] = {XB_SW_X0_Pin, XB_SW_X1_Pin, XB_SW_X2_Pin, XB_SW_X3_Pin};
+	static const uint16_t y_pins[] = {XB_SW_Y0_Pin, XB_SW_Y1_Pin, XB_SW_Y2_Pin};
+
+	this->_addr_port = addr_ports[0];
+	for(uint32_t i = 1; i < sizeof(addr_ports)/sizeof(addr_ports[0]); i++) {
+		if(addr_ports[i] != this->_addr_port) {
+			POST_ERROR(Err_Handler::EH_LPME);
+		}
+	}
+
+	/* Precompute the address line BSRR values */
+	for(uint32_t x = 0; x < MAX_ROWS; x++) {
+		this->_x_bsrr[x] = _bsrr_value(x_pins, 4, x_map[x]);
+	}
+	for(uint32_t y = 0; y < MAX_COLUMNS; y++) {
+		this->_y_bsrr[y] = _bsrr_value(y_pins, 3, y);
+	}
+
 	this->_lock = osMutexNew(&xps_mutex_attr);
 	this->clear();
 }
@@ -52,58 +74,72 @@ void Xps::clear(void) {
 	Utility.pulse_gpio_pin(XB_SW_RESET);
 }
 
-void Xps::modify(uint32_t x, uint32_t y, uint32_t cs_number, bool state) {
-	/* Check inputs */
-	if((x >= MAX_ROWS) || (y >= MAX_COLUMNS)) {
-		POST_ERROR(Err_Handler::EH_IVXY);
-	}
-	/* Get the lock */
-
-	osStatus status = osMutexAcquire(this->_lock, 20U);
-	if(status != osOK) {
-		POST_ERROR(Err_Handler::EH_LAF);
-	}
-
-	x = x_map[x];
-
-	/* Set up the x and y data bits */
-	Utility.set_gpio_pin_state(XB_SW_X0, x & 1 );
-	x >>= 1;
-
-	Utility.set_gpio_pin_state(XB_SW_X1, x & 1 );
-	x >>= 1;
-
-	Utility.set_gpio_pin_state(XB_SW_X2, x & 1 );
-	x >>= 1;
-
-	Utility.set_gpio_pin_state(XB_SW_X3, x & 1 );
-
+/*
+ * Write one crosspoint change to the chips.
+ *
+ * Must be called with the lock held and the inputs checked.
+ */
 
-	Utility.set_gpio_pin_state(XB_SW_Y0, y & 1 );
-	y >>= 1;
+void Xps::_write_op(const Xps_Op *op) {
+	/* Set up the x and y address bits */
+	this->_addr_port->BSRR = this->_x_bsrr[op->x] | this->_y_bsrr[op->y];
 
-	Utility.set_gpio_pin_state(XB_SW_Y1, y & 1 );
-	y >>= 1;
+	/* Set the data bit */
+	XB_SW_DATA_GPIO_Port->BSRR = (op->state) ? XB_SW_DATA_Pin : ((uint32_t) XB_SW_DATA_Pin) << 16;
 
-	Utility.set_gpio_pin_state(XB_SW_Y2, y & 1 );
+	/* Set the chip CS */
+	uint16_t cs_pin = cs_pins[op->cs_number];
+	GPIO_TypeDef *cs_port = cs_ports[op->cs_number];
+	cs_port->BSRR = cs_pin;
 
+	/* Pulse the strobe line */
+	XB_SW_STB_GPIO_Port->BSRR = XB_SW_STB_Pin;
+	for (volatile uint8_t i=0; i<= 10; i++);
+	XB_SW_STB_GPIO_Port->BSRR = ((uint32_t) XB_SW_STB_Pin) << 16;
 
-	/* Set the data bit */
+	/* Clear the chip CS */
+	cs_port->BSRR = ((uint32_t) cs_pin) << 16;
+}
 
-	Utility.set_gpio_pin_state(XB_SW_DATA, state);
+void Xps::modify(uint32_t x, uint32_t y, uint32_t cs_number, bool state) {
+	Xps_Op op = {(uint8_t) x, (uint8_t) y, (uint8_t) cs_number, state};
 
-	/* Set the chip CS */
+	/* Check inputs */
+	if((x >= MAX_ROWS) || (y >= MAX_COLUMNS)) {
+		POST_ERROR(Err_Handler::EH_IVXY);
+	}
 
-	this->_set_cs_state(cs_number, true);
+	this->modify_batch(&op, 1);
+}
 
-	/* Pulse the strobe line */
+/*
+ * Apply a list of crosspoint changes in order, taking the lock once
+ */
 
-	Utility.pulse_gpio_pin(XB_SW_STB);
+void Xps::modify_batch(const Xps_Op *ops, uint32_t count) {
+	if(!ops) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+	/* Check inputs */
+	for(uint32_t i = 0; i < count; i++) {
+		if((ops[i].x >= MAX_ROWS) || (ops[i].y >= MAX_COLUMNS)) {
+			POST_ERROR(Err_Handler::EH_IVXY);
+		}
+		if(ops[i].cs_number >= MAX_CPS_CHIPS) {
+			POST_ERROR(Err_Handler::EH_ICSN);
+		}
+	}
 
-	/* Clear the chip CS */
+	/* Get the lock */
 
-	this->_set_cs_state(cs_number, false);
+	osStatus status = osMutexAcquire(this->_lock, 20U);
+	if(status != osOK) {
+		POST_ERROR(Err_Handler::EH_LAF);
+	}
 
+	for(uint32_t i = 0; i < count; i++) {
+		this->_write_op(&ops[i]);
+	}
 
 	/* Release the lock */
 	osMutexRelease(this->_lock);
@@ -50,6 +50,7 @@ static const Error_Table_Entry Error_table[] = {
 		{ACTION_PANIC, "Invalid command"},
 		{ACTION_PANIC, "Unsupported feature"}, /* 40 */
 		{ACTION_PANIC, "No resource"},
+		{ACTION_PANIC, "Could not create event flags"},
 
 
 
@@ -40,6 +40,14 @@ void Event::init(void) {
 		0U
 	};
 
+	/* Event flags attributes */
+	static const osEventFlagsAttr_t event_flags_attr = {
+		"EventWorkerFlags",
+		0,
+		NULL,
+		0
+	};
+
 	/* Worker thread attributes */
 	static const osThreadAttr_t worker_attr = {
 			"EventWorkerThread",
@@ -60,6 +68,12 @@ void Event::init(void) {
 		POST_ERROR(Err_Handler::EH_LCE);
 	}
 
+	/* Create event flags used to wake the worker */
+	this->_event_flags = osEventFlagsNew(&event_flags_attr);
+	if (this->_event_flags == NULL) {
+		POST_ERROR(Err_Handler::EH_EFC);
+	}
+
 	/* Create worker task */
 	if(osThreadNew(_worker, NULL, &worker_attr) == NULL) {
 		POST_ERROR(Err_Handler::EH_TSF);
@@ -69,6 +83,20 @@ void Event::init(void) {
 }
 
 
+/*
+ * Wake the worker thread.
+ *
+ * Called when work has been posted to a line or trunk.
+ */
+
+void Event::wake(void) {
+	/* Events posted before the worker is running will be picked up on its first pass */
+	if(this->_event_flags) {
+		osEventFlagsSet(this->_event_flags, EF_WORK_POSTED);
+	}
+}
+
+
 /*
  * Line handler static function
  */
@@ -93,45 +121,41 @@ static void __trunk_handler(uint32_t event_type, uint32_t resource ) {
  */
 
 void Event::worker(void *args) {
-	uint32_t card = 0;
-	Card_Comm::Event_Handler handler = NULL;
+	uint32_t last_tick = osKernelGetTickCount();
 
 
 	/*
-	 * This loop handles setting up and taking down calls, polling the DTMF receivers, and looking for attention events
-	 * It runs once every 10 milliseconds.
+	 * This loop handles setting up and taking down calls, polling the DTMF receivers, and looking for attention events.
+	 *
+	 * It runs as soon as a line or trunk posts an event, and at least once every 10 milliseconds.
+	 * The DTMF receivers and the attention lines are only polled on the 10 millisecond tick.
+	 * All attention lines are sampled at once, and event reads for every card asserting attention
+	 * are queued together.
 	 */
 
 
 	for(;;) {
-		osDelay(10);
-
-		/* Poll DTMF receivers */
-		Dtmf_receivers.poll();
+		osEventFlagsWait(this->_event_flags, EF_WORK_POSTED, osFlagsWaitAny, TICK_TIME);
 
-		/* Poll ONE card on each 10ms pass */
+		uint32_t now = osKernelGetTickCount();
+		bool tick = ((now - last_tick) >= TICK_TIME);
 
-		bool atten = Attention.get_state(card);
+		if(tick) {
+			last_tick = now;
 
-		if(atten) {
-			if(card >= Sub_Line::MAX_DUAL_LINE_CARDS) {
-				handler = __trunk_handler;
-			}
-			else {
-				handler = __line_handler;
-			}
-			Card_comm.queue_get_event_request(card, handler);
-		}
+			/* Poll DTMF receivers */
+			Dtmf_receivers.poll();
 
+			/* Sample the attention lines of all cards */
+			uint32_t asserted = Attention.get_snapshot();
 
-		/* Card to poll next time */
-		card += 1;
-		if(card >= Atten::MAX_NUM_CARDS) {
-			card = 0;
+			if(asserted) {
+				Card_comm.queue_get_event_requests(asserted, __line_handler, __trunk_handler);
+			}
 		}
 
-		Trunks.poll();
-		Sub_line.poll();
+		Trunks.poll(tick);
+		Sub_line.poll(tick);
 	}
 
 }
@@ -9,8 +9,18 @@ HW_Pres::HW_Pres HW_pres;
 namespace HW_Pres {
 
 
+static const char *TAG = "hwpres";
+
+/* Event flags attributes */
+static const osEventFlagsAttr_t event_flags_attr = {
+	"HWPresEventFlags",
+	0,
+	NULL,
+	0
+};
+
 /*
- * Callback to get status of last I2C transaction
+ * Callback to get status of a probe transaction
  */
 
 static void _probe_callback(uint32_t type, uint32_t status, uint32_t trans_id) {
@@ -19,86 +29,106 @@ static void _probe_callback(uint32_t type, uint32_t status, uint32_t trans_id) {
 
 
 void HW_Pres::probe_callback(uint32_t type, uint32_t status, uint32_t trans_id) {
-	this->_response_received = true;
-	this->_response_status = status;
+	if(trans_id >= NUM_CARD_POSITIONS) {
+		POST_ERROR(Err_Handler::EH_IVCN);
+	}
+	this->_response_status[trans_id] = status;
+	osEventFlagsSet(this->_event_flags, (1 << trans_id));
 
 }
 
-void HW_Pres::probe(void) {
+/*
+ * Probe for installed cards.
+ *
+ * The probe transactions for all card positions are queued at once.
+ * Each card position sets its own event flag when its transaction completes,
+ * and a card which has not responded by the time PROBE_TIMEOUT expires is treated as absent.
+ */
 
-	/*
-	 * Test for line cards first
-	 */
+void HW_Pres::probe(void) {
 
 	this->_num_installed_dual_line_cards = this->_installed_dual_line_cards =
 	this->_num_installed_trunk_cards = this->_installed_trunk_cards = 0;
 
-	for(uint8_t index = 0; index < Sub_Line::MAX_DUAL_LINE_CARDS; index++) {
-		uint8_t data[2] = {0, 0};
-		bool failed = false;
-		/*
-		 * Attempt power off and look for I2C errors
-		 */
-		/* first line */
-		this->_response_received = false;
-		data[0] = 0;
-		I2c.queue_transaction(I2C_Engine::I2CT_WRITE_REG8, 0,  index, Sub_Line::LINE_CARD_I2C_ADDRESS,
-				Sub_Line::REG_POWER_CTRL, 2, data, _probe_callback);
-		while(this->_response_received == false) {
-			osDelay(1);
-		}
-		if(this->_response_status != I2C_Engine::I2CEC_OK) {
-			failed = true;
+	if(!this->_event_flags) {
+		this->_event_flags = osEventFlagsNew(&event_flags_attr);
+		if(!this->_event_flags) {
+			POST_ERROR(Err_Handler::EH_EFC);
 		}
+	}
+	osEventFlagsClear(this->_event_flags, (1 << NUM_CARD_POSITIONS) - 1);
 
-		/* Second line */
+	/* Give the cards time to start up */
+	uint32_t now = osKernelGetTickCount();
+	if(now < CARD_STARTUP_TIME) {
+		osDelay(CARD_STARTUP_TIME - now);
+	}
 
+	uint32_t start_time = osKernelGetTickCount();
+	uint32_t queued = 0;
 
-		if(!failed) {
-			this->_response_received = false;
-			data[0] = 1;
-			I2c.queue_transaction(I2C_Engine::I2CT_WRITE_REG8, 0,  index, Sub_Line::LINE_CARD_I2C_ADDRESS,
-					Sub_Line::REG_POWER_CTRL, 2, data, _probe_callback);
-			while(this->_response_received == false)  {
-				osDelay(1);
-			}
+	/*
+	 * Line cards: attempt power off on both lines and look for I2C errors
+	 */
 
-			if(this->_response_status != I2C_Engine::I2CEC_OK) {
-				failed = true;
-			}
+	for(uint8_t index = 0; index < Sub_Line::MAX_DUAL_LINE_CARDS; index++) {
+		for(uint8_t line = 0; line < 2; line++) {
+			this->_probe_data[index][line][0] = line;
+			this->_probe_data[index][line][1] = 0;
+			this->_probe_steps[index][line].type = I2C_Engine::I2CT_WRITE_REG8;
+			this->_probe_steps[index][line].register_address = Sub_Line::REG_POWER_CTRL;
+			this->_probe_steps[index][line].data_length = 2;
+			this->_probe_steps[index][line].data = this->_probe_data[index][line];
 		}
-
-		if(!failed) {
-			this->_installed_dual_line_cards |= (1 << index);
-			this->_num_installed_dual_line_cards++;
+		this->_response_status[index] = I2C_Engine::I2CEC_NO_DEVICE;
+		if(I2c.queue_chain(0, index, Sub_Line::LINE_CARD_I2C_ADDRESS, this->_probe_steps[index], 2, _probe_callback, index)) {
+			queued |= (1 << index);
 		}
-
 	}
 
+	/*
+	 * Trunk cards: attempt trunk card reset
+	 */
+
 	for(uint8_t index = 0; index < Trunk::MAX_TRUNK_CARDS; index++) {
-		uint8_t data[2] = {0, 0};
-		bool failed = false;
-		/*
-		 * Attempt trunk card reset
-		 */
-		this->_response_received = false;
-		data[0] = 0;
-		I2c.queue_transaction(I2C_Engine::I2CT_WRITE_REG8, 0,  index + Sub_Line::MAX_DUAL_LINE_CARDS, Trunk::TRUNK_CARD_I2C_ADDRESS,
-				Trunk::REG_RESET, 2, data, _probe_callback);
-		while(this->_response_received == false) {
-			osDelay(1);
+		uint8_t card = index + Sub_Line::MAX_DUAL_LINE_CARDS;
+		this->_probe_data[card][0][0] = 0;
+		this->_probe_data[card][0][1] = 0;
+		this->_response_status[card] = I2C_Engine::I2CEC_NO_DEVICE;
+		if(I2c.queue_transaction(I2C_Engine::I2CT_WRITE_REG8, 0, card, Trunk::TRUNK_CARD_I2C_ADDRESS,
+				Trunk::REG_RESET, 2, this->_probe_data[card][0], _probe_callback, card)) {
+			queued |= (1 << card);
 		}
-		if(this->_response_status != I2C_Engine::I2CEC_OK) {
-			failed = true;
+	}
+
+	/* Wait for all the queued probes to complete */
+	uint32_t completed = 0;
+	if(queued) {
+		uint32_t flags = osEventFlagsWait(this->_event_flags, queued, osFlagsWaitAll | osFlagsNoClear, PROBE_TIMEOUT);
+		completed = (flags & osFlagsError) ? osEventFlagsGet(this->_event_flags) : flags;
+		completed &= queued;
+	}
+	if(completed != queued) {
+		LOG_WARN(TAG, "Probe timed out, card positions not responding: %02X", (unsigned) (queued & ~completed));
+	}
+
+	for(uint8_t index = 0; index < Sub_Line::MAX_DUAL_LINE_CARDS; index++) {
+		if((completed & (1 << index)) && (this->_response_status[index] == I2C_Engine::I2CEC_OK)) {
+			this->_installed_dual_line_cards |= (1 << index);
+			this->_num_installed_dual_line_cards++;
 		}
+	}
 
-		if(!failed) {
+	for(uint8_t index = 0; index < Trunk::MAX_TRUNK_CARDS; index++) {
+		uint8_t card = index + Sub_Line::MAX_DUAL_LINE_CARDS;
+		if((completed & (1 << card)) && (this->_response_status[card] == I2C_Engine::I2CEC_OK)) {
 			this->_installed_trunk_cards |= (1 << index);
 			this->_num_installed_trunk_cards++;
 		}
-
 	}
 
+	LOG_INFO(TAG, "Probe found %u line cards and %u trunk cards in %u ms", this->_num_installed_dual_line_cards,
+			this->_num_installed_trunk_cards, (unsigned) (osKernelGetTickCount() - start_time));
 
 }
 
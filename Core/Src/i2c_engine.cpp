@@ -38,6 +38,13 @@ static const osThreadAttr_t worker_attr = {
 };
 
 
+/* Bus thread names */
+static const char *bus_names[] = {"I2CEngineBus0", "I2CEngineBus1"};
+
+/* I2C peripheral handles in bus number order */
+static I2C_HandleTypeDef *bus_handles[] = {&hi2c1, &hi2c4};
+
+
 /*
  * Trick to call a C++ method from the RTOS
  */
@@ -73,18 +80,34 @@ bool I2C_Engine::_check_i2c_message(I2C_Queue_Message *m, uint8_t expected_messa
  */
 
 void I2C_Engine::init(void) {
-	/* Create event flags */
-	this->_event_flags = osEventFlagsNew(&event_flags_attributes);
 
-	/* Create i2c busses queue */
-	this->_queue_i2c_busses = osMessageQueueNew (4, sizeof(I2C_Queue_Message), &queue_I2C_Busses_attributes);
+	for(uint8_t bus_num = 0; bus_num < NUM_I2C_BUSSES; bus_num++) {
+		I2C_Bus *bus = &this->_busses[bus_num];
+		bus->bus_num = bus_num;
+		bus->state = I2CS_IDLE;
+		bus->selected_channel = -1;
+		bus->handle = bus_handles[bus_num];
 
-	/* Create queue_I2C_transactions */
-	this->_queue_i2c_transactions = osMessageQueueNew (I2C_TRANSACTION_QUEUE_DEPTH, sizeof(I2C_Transaction), &queue_I2C_transactions_attributes);
+		/* Create event flags */
+		bus->event_flags = osEventFlagsNew(&event_flags_attributes);
 
-	/* Create worker task */
-	if(osThreadNew(_worker, NULL, &worker_attr) == NULL) {
-		POST_ERROR(Err_Handler::EH_TSF);
+		/* Create the interrupt message queue */
+		bus->queue_isr = osMessageQueueNew (I2C_ISR_QUEUE_DEPTH, sizeof(I2C_Queue_Message), &queue_I2C_Busses_attributes);
+
+		/* Create the transaction queues */
+		bus->queue_transactions[I2CP_HIGH] = osMessageQueueNew (I2C_HIGH_PRIORITY_QUEUE_DEPTH, sizeof(I2C_Transaction), &queue_I2C_transactions_attributes);
+		bus->queue_transactions[I2CP_NORMAL] = osMessageQueueNew (I2C_TRANSACTION_QUEUE_DEPTH, sizeof(I2C_Transaction), &queue_I2C_transactions_attributes);
+
+		if((!bus->event_flags) || (!bus->queue_isr) || (!bus->queue_transactions[I2CP_HIGH]) || (!bus->queue_transactions[I2CP_NORMAL])) {
+			POST_ERROR(Err_Handler::EH_MQCF);
+		}
+
+		/* Create a worker task for the bus */
+		osThreadAttr_t attr = worker_attr;
+		attr.name = bus_names[bus_num];
+		if(osThreadNew(_worker, bus, &attr) == NULL) {
+			POST_ERROR(Err_Handler::EH_TSF);
+		}
 	}
 
 }
@@ -94,7 +117,7 @@ void I2C_Engine::init(void) {
  *
  * Return true if successful, false if otherwise
  *
- * Type can be I2CT_READ_REG8 or I2CT_WRITE_REG8
+ * Type can be I2CT_READ_REG8, I2CT_READ_REG8_RS or I2CT_WRITE_REG8
  * Bus can be 0 or 1
  * The expander_channel parameter can be  -1 if no expander is used, otherwise a channel number from 0 to 7.
  * Device Address is a 7 bit I1C drvice address
@@ -103,6 +126,9 @@ void I2C_Engine::init(void) {
  * Register data is a pointer to the read or write buffer.
  * Callback is the address of the callback function. The callback parameter is optional.
  * Trans ID is an optional transaction number. Will default to 0 if not passed in.
+ * Priority is I2CP_HIGH for signalling-critical transactions, or I2CP_NORMAL.
+ * Deadline is the optional number of milliseconds within which the transaction must be started.
+ * If it can't be started in time, it is not sent and the callback gets I2CEC_DEADLINE_MISSED.
  *
  * Returns true if successful, else false if the queue is full.
  */
@@ -110,23 +136,26 @@ void I2C_Engine::init(void) {
 
 bool I2C_Engine::queue_transaction(uint32_t type, uint32_t bus, int32_t expander_channel, uint32_t device_address,
 		uint32_t register_address, uint32_t data_length, uint8_t *register_data,
-		I2C_Callback_Type callback, uint32_t trans_id) {
+		I2C_Callback_Type callback, uint32_t trans_id, uint32_t priority, uint32_t deadline) {
 	I2C_Transaction trans;
 
 	/*  Sanity check parameters */
-	if((type >= I2CT_MAX_I2C_TYPES) || (device_address > 0x7F) || (expander_channel > 7) || (expander_channel < -1) ||
-			(bus >= NUM_I2C_BUSSES) || (data_length > MAX_I2C_REG_DATA) || (!register_data) ) {
+	if((type >= I2CT_MAX_I2C_TYPES) || (type == I2CT_CHAIN) || (device_address > 0x7F) || (expander_channel > 7) || (expander_channel < -1) ||
+			(bus >= NUM_I2C_BUSSES) || (data_length > MAX_I2C_REG_DATA) || (!register_data) || (priority >= NUM_I2C_PRIORITIES)) {
 		POST_ERROR(Err_Handler::EH_INVP);
 	}
 	trans.id = trans_id;
 	trans.type = type;
+	trans.op = type;
+	trans.chain = NULL;
+	trans.chain_length = trans.chain_index = 0;
 	trans.bus_num = bus;
 	trans.expander_channel = (int8_t) expander_channel;
 	trans.device_address = device_address;
 	trans.device_address8 = device_address << 1;
 	trans.register_address = register_address;
 	trans.data_length = data_length;
-	if(type == I2CT_READ_REG8) {
+	if((type == I2CT_READ_REG8) || (type == I2CT_READ_REG8_RS)) {
 		trans.read_data = register_data;
 	}
 	else {
@@ -136,28 +165,107 @@ bool I2C_Engine::queue_transaction(uint32_t type, uint32_t bus, int32_t expander
 		}
 	}
 	trans.callback = callback;
+	trans.priority = priority;
+	trans.deadline = deadline;
 
-	/* Choose the correct I2C bus handle */
-	switch(trans.bus_num) {
-		case 0:
-			trans.bus = &hi2c1;
-			break;
+	return this->_queue(&trans);
+}
+
+/*
+ * Queue a chain of register reads and writes to one device.
+ *
+ * The expander channel is selected once, then the steps are run in order.
+ * The chain stops at the first step which fails.
+ * The callback is called once with type I2CT_CHAIN when the chain finishes.
+ *
+ * The steps and the buffers they point to must remain valid until the callback is called.
+ *
+ * Returns true if successful, else false if the queue is full.
+ */
 
-		case 1:
-			trans.bus = &hi2c4;
-			break;
+bool I2C_Engine::queue_chain(uint32_t bus, int32_t expander_channel, uint32_t device_address,
+		const I2C_Chain_Step *steps, uint32_t num_steps, I2C_Callback_Type callback, uint32_t trans_id,
+		uint32_t priority, uint32_t deadline) {
+	I2C_Transaction trans;
 
+	/*  Sanity check parameters */
+	if((!steps) || (num_steps == 0) || (num_steps > MAX_I2C_CHAIN_STEPS) || (device_address > 0x7F) ||
+			(expander_channel > 7) || (expander_channel < -1) || (bus >= NUM_I2C_BUSSES) || (priority >= NUM_I2C_PRIORITIES)) {
+		POST_ERROR(Err_Handler::EH_INVP);
 	}
+	for(uint32_t index = 0; index < num_steps; index++) {
+		if(((steps[index].type != I2CT_READ_REG8) && (steps[index].type != I2CT_WRITE_REG8) &&
+				(steps[index].type != I2CT_READ_REG8_RS)) ||
+				(steps[index].data_length > MAX_I2C_REG_DATA) || (!steps[index].data)) {
+			POST_ERROR(Err_Handler::EH_INVP);
+		}
+	}
+
+	trans.id = trans_id;
+	trans.type = I2CT_CHAIN;
+	trans.chain = steps;
+	trans.chain_length = num_steps;
+	trans.chain_index = 0;
+	trans.bus_num = bus;
+	trans.expander_channel = (int8_t) expander_channel;
+	trans.device_address = device_address;
+	trans.device_address8 = device_address << 1;
+	trans.callback = callback;
+	trans.priority = priority;
+	trans.deadline = deadline;
+
+	return this->_queue(&trans);
+}
+
+/*
+ * Load the current chain step into the transaction
+ */
+
+void I2C_Engine::_load_chain_step(I2C_Transaction *trans) {
+	const I2C_Chain_Step *step = &trans->chain[trans->chain_index];
+
+	trans->op = step->type;
+	trans->register_address = step->register_address;
+	trans->data_length = step->data_length;
+	if(step->type == I2CT_WRITE_REG8) {
+		trans->read_data = NULL;
+		memcpy(trans->local_register_data + 1, step->data, step->data_length);
+	}
+	else {
+		trans->read_data = step->data;
+	}
+}
+
+/*
+ * Put a transaction on its bus queue and wake the bus worker
+ */
+
+bool I2C_Engine::_queue(I2C_Transaction *trans) {
+
+	/* Choose the correct I2C bus */
+	I2C_Bus *b = &this->_busses[trans->bus_num];
+	trans->bus = b->handle;
+
 	/* Queue Transaction */
 	osStatus_t status;
 
 
 
+	osMessageQueueId_t queue = b->queue_transactions[trans->priority];
+	I2C_Queue_Stats *stats = &b->stats[trans->priority];
+
 	osKernelLock(); /* Critical section start */
 
-	status = osMessageQueuePut(this->_queue_i2c_transactions, &trans, 0U, 0U );
+	trans->queue_time = osKernelGetTickCount();
+	status = osMessageQueuePut(queue, trans, 0U, 0U );
 	if(status == osOK) {
-		osEventFlagsSet(this->_event_flags, EVENT_FLAG_WORK);
+		/* Update the queue statistics */
+		uint32_t depth = osMessageQueueGetCount(queue);
+		stats->queued++;
+		if(depth > stats->max_depth) {
+			stats->max_depth = depth;
+		}
+		osEventFlagsSet(b->event_flags, EVENT_FLAG_WORK);
 		osKernelUnlock(); /* Critical section end */
 		return true;
 	}
@@ -169,44 +277,66 @@ bool I2C_Engine::queue_transaction(uint32_t type, uint32_t bus, int32_t expander
 }
 
 
+/*
+ * Return a copy of the queue statistics for one priority on a bus
+ */
+
+void I2C_Engine::get_queue_stats(uint32_t bus, uint32_t priority, I2C_Queue_Stats &stats) {
+	if((bus >= NUM_I2C_BUSSES) || (priority >= NUM_I2C_PRIORITIES)) {
+		POST_ERROR(Err_Handler::EH_INVP);
+	}
+	osKernelLock(); /* Critical section start */
+	stats = this->_busses[bus].stats[priority];
+	osKernelUnlock(); /* Critical section end */
+}
+
+
 /*
  * Return TRUE if working
  */
 
 bool I2C_Engine::is_working(void) {
-		return this->_working;
+	for(uint8_t bus_num = 0; bus_num < NUM_I2C_BUSSES; bus_num++) {
+		if(this->_busses[bus_num].working) {
+			return true;
+		}
 	}
+	return false;
+}
 
 
 /*
  * Called repeatedly after RTOS initialization
+ *
+ * There is one of these running for each bus. Args points to the bus state.
  */
 
 void I2C_Engine::worker(void *args) {
+	I2C_Bus *b = (I2C_Bus *) args;
 	osStatus_t status;
 	I2C_Queue_Message msg;
 	uint32_t event_flag;
 	int res;
 
 	for(;;) {
-		if(this->_state == I2CS_IDLE) { /* If we need to wait for work */
-			event_flag = osEventFlagsWait(this->_event_flags, EVENT_FLAG_WORK, osFlagsNoClear, osWaitForever );
-			this->_working = true;
+		if(b->state == I2CS_IDLE) { /* If we need to wait for work */
+			event_flag = osEventFlagsWait(b->event_flags, EVENT_FLAG_WORK, osFlagsNoClear, osWaitForever );
+			b->working = true;
 		}
-		else if ((this->_state == I2CS_EXP_WRITE_WAIT) || /* If we need to wait for an I2C interrupt */
-				(this->_state == I2CS_READ_REG_WAIT_REG_XMIT) ||
-				(this->_state == I2CS_READ_REG_WAIT_RCV) ||
-				(this->_state == I2CS_WRITE_REG_WAIT_DATA_XMIT)) {
-			event_flag = osEventFlagsWait(this->_event_flags, EVENT_FLAG_ISR, 0, osWaitForever);
+		else if ((b->state == I2CS_EXP_WRITE_WAIT) || /* If we need to wait for an I2C interrupt */
+				(b->state == I2CS_READ_REG_WAIT_REG_XMIT) ||
+				(b->state == I2CS_READ_REG_WAIT_RCV) ||
+				(b->state == I2CS_WRITE_REG_WAIT_DATA_XMIT)) {
+			event_flag = osEventFlagsWait(b->event_flags, EVENT_FLAG_ISR, 0, osWaitForever);
 		}
 
 
 		/* Process an I2C interrupt event if there is one */
 		if((event_flag & EVENT_FLAG_ISR) == EVENT_FLAG_ISR) {
-			status = osMessageQueueGet(this->_queue_i2c_busses, &msg, NULL, osWaitForever);
+			status = osMessageQueueGet(b->queue_isr, &msg, NULL, osWaitForever);
 			if (status == osOK) {
 				event_flag &= ~ EVENT_FLAG_ISR;
-				this->_i2c_msg_ready = true;
+				b->i2c_msg_ready = true;
 			}
 			else {
 				LOG_ERROR(TAG, "osMessageQueGet() failed");
@@ -214,32 +344,59 @@ void I2C_Engine::worker(void *args) {
 		}
 
 
-		switch(this->_state) {
-			case I2CS_IDLE: /* Look for work */
+		switch(b->state) {
+			case I2CS_IDLE: { /* Look for work */
+				/* Take work from the highest priority queue which has some */
+				osMessageQueueId_t queue = NULL;
+				I2C_Queue_Stats *stats = NULL;
 				osKernelLock(); /* Critical section start */
-				if (osMessageQueueGetCount(this->_queue_i2c_transactions)) {
-					status = osMessageQueueGet(this->_queue_i2c_transactions, &this->trans, NULL, 0);
+				for(uint32_t priority = 0; priority < NUM_I2C_PRIORITIES; priority++) {
+					if(osMessageQueueGetCount(b->queue_transactions[priority])) {
+						queue = b->queue_transactions[priority];
+						stats = &b->stats[priority];
+						break;
+					}
+				}
+				if (queue) {
+					status = osMessageQueueGet(queue, &b->trans, NULL, 0);
 					if (status == osOK) {
-						/* Decode Transaction Type */
+						/* Update the wait time statistics */
+						uint32_t wait = osKernelGetTickCount() - b->trans.queue_time;
+						stats->total_wait += wait;
+						if(wait > stats->max_wait) {
+							stats->max_wait = wait;
+						}
+						bool late = ((b->trans.deadline) && (wait > b->trans.deadline));
+						if(late) {
+							stats->deadline_misses++;
+						}
 						osKernelUnlock(); /* Critical section end */
-						if(this->trans.expander_channel >= 0) {
+
+						/* Decode Transaction Type */
+						if(late) {
+							/* Too late to be useful, don't send it */
+							b->trans.status = I2CEC_DEADLINE_MISSED;
+							b->state = I2CS_FINISH;
+						}
+						else if((b->trans.expander_channel >= 0) && (b->trans.expander_channel != b->selected_channel)) {
 							/* Set up I2C expander first */
-							this->trans.local_register_data[0] = (1 << this->trans.expander_channel);
-							this->_i2c_msg_ready = false;
+							b->trans.local_register_data[0] = (1 << b->trans.expander_channel);
+							b->i2c_msg_ready = false;
 							/* Do write transaction for expander */
-							res = HAL_I2C_Master_Transmit_DMA(this->trans.bus, (I2C_BUS_EXPANDER_ADDRESS << 1), this->trans.local_register_data, 1);
+							res = HAL_I2C_Master_Transmit_DMA(b->trans.bus, (I2C_BUS_EXPANDER_ADDRESS << 1), b->trans.local_register_data, 1);
 							if (res != HAL_OK) {
 								LOG_ERROR(TAG, "HAL_I2C_Master_Transmit_DMA failed");
-								this->trans.hal_i2c_error_code = this->trans.bus->ErrorCode;
-								this->trans.status = I2CEC_DMA_FAILED;
-								this->_state = I2CS_FINISH;
+								b->trans.hal_i2c_error_code = b->trans.bus->ErrorCode;
+								b->trans.status = I2CEC_DMA_FAILED;
+								b->state = I2CS_FINISH;
 							}
 							else {
-								this->_state = I2CS_EXP_WRITE_WAIT;
+								b->state = I2CS_EXP_WRITE_WAIT;
 							}
 						}
 						else {
-							this->_state = I2CS_DO_REGISTER_RW;
+							/* No expander, or the channel is already selected */
+							b->state = I2CS_DO_REGISTER_RW;
 						}
 					}
 					else {
@@ -249,169 +406,205 @@ void I2C_Engine::worker(void *args) {
 				}
 				else {
 					/* No work left in queue, clear the event flag */
-					osEventFlagsClear(this->_event_flags, EVENT_FLAG_WORK );
+					osEventFlagsClear(b->event_flags, EVENT_FLAG_WORK );
 					event_flag &= ~ EVENT_FLAG_WORK;
-					this->_working = false;
+					b->working = false;
 					osKernelUnlock(); /* Critical section end */
 				}
+			}
 				break;
 
 
 			case I2CS_EXP_WRITE_WAIT: /* Wait for bus expander write to complete */
-				if (this->_i2c_msg_ready) {
-					this->_i2c_msg_ready = false;
+				if (b->i2c_msg_ready) {
+					b->i2c_msg_ready = false;
 					if (this->_check_i2c_message(&msg, MSG_I2C_TX)) { /* Expected response */
-						this->_state = I2CS_DO_REGISTER_RW;
+						b->selected_channel = b->trans.expander_channel;
+						b->state = I2CS_DO_REGISTER_RW;
 						}
 					else { /* Unexpected response */
-						this->trans.hal_i2c_error_code = this->trans.bus->ErrorCode;
-						if (this->trans.hal_i2c_error_code == HAL_I2C_ERROR_AF) {
-							this->trans.status = I2CEC_NO_DEVICE;
+						b->trans.hal_i2c_error_code = b->trans.bus->ErrorCode;
+						if (b->trans.hal_i2c_error_code == HAL_I2C_ERROR_AF) {
+							b->trans.status = I2CEC_NO_DEVICE;
 						}
 						else {
-							this->trans.status = I2CEC_TRANS_FAILED;
+							b->trans.status = I2CEC_TRANS_FAILED;
 						}
-						this->_state = I2CS_FINISH;
+						b->state = I2CS_FINISH;
 					}
 				}
 				break;
 
 
 			case I2CS_DO_REGISTER_RW: /* Set the I2C transaction state based on the type */
-				switch (this->trans.type) {
+				if(b->trans.chain) {
+					this->_load_chain_step(&b->trans);
+				}
+				switch (b->trans.op) {
 						case I2CT_READ_REG8:
-							this->_state = I2CS_READ_REG;
+							b->state = I2CS_READ_REG;
+							break;
+						case I2CT_READ_REG8_RS:
+							b->state = I2CS_READ_REG_RS;
 							break;
 						case I2CT_WRITE_REG8:
-							this->_state = I2CS_WRITE_REG;
+							b->state = I2CS_WRITE_REG;
 							break;
 					}
 				break;
 
 
+			case I2CS_READ_REG_RS: /* Start I2C register read with a repeated start */
+				b->i2c_msg_ready = false;
+				/* Write the register address, then read the data without releasing the bus */
+				res = HAL_I2C_Mem_Read_DMA(b->trans.bus, b->trans.device_address8, b->trans.register_address,
+						I2C_MEMADD_SIZE_8BIT, b->trans.local_register_data, b->trans.data_length);
+				if (res != HAL_OK) {
+					LOG_ERROR(TAG, "HAL_I2C_Mem_Read_DMA failed");
+					b->trans.hal_i2c_error_code = b->trans.bus->ErrorCode;
+					b->trans.status = I2CEC_DMA_FAILED;
+					b->state = I2CS_FINISH;
+				}
+				else {
+					b->state = I2CS_READ_REG_WAIT_RCV;
+				}
+				break;
+
+
 			case I2CS_READ_REG:  /* Start I2C register read */
-				this->_i2c_msg_ready = false;
+				b->i2c_msg_ready = false;
 				/* Send write register address transaction */
-				res = HAL_I2C_Master_Transmit_DMA(this->trans.bus, this->trans.device_address8, &this->trans.register_address, 1);
+				res = HAL_I2C_Master_Transmit_DMA(b->trans.bus, b->trans.device_address8, &b->trans.register_address, 1);
 				if (res != HAL_OK) {
 					LOG_ERROR(TAG, "HAL_I2C_Master_Transmit_DMA failed");
-					this->trans.hal_i2c_error_code = this->trans.bus->ErrorCode;
-					this->trans.status = I2CEC_DMA_FAILED;
-					this->_state = I2CS_FINISH;
+					b->trans.hal_i2c_error_code = b->trans.bus->ErrorCode;
+					b->trans.status = I2CEC_DMA_FAILED;
+					b->state = I2CS_FINISH;
 				}
 				else { /* Write register address DMA was started */
-					this->_state = I2CS_READ_REG_WAIT_REG_XMIT;
+					b->state = I2CS_READ_REG_WAIT_REG_XMIT;
 				}
 				break;
 
 
 			case I2CS_READ_REG_WAIT_REG_XMIT: /* Wait for transmit register address to complete */
-				if (this->_i2c_msg_ready) {
-					this->_i2c_msg_ready = false;
+				if (b->i2c_msg_ready) {
+					b->i2c_msg_ready = false;
 					if (this->_check_i2c_message(&msg, MSG_I2C_TX)) {
 						/* Expected response. Get the register data */
-						res = HAL_I2C_Master_Receive_DMA(this->trans.bus, this->trans.device_address8, this->trans.local_register_data, this->trans.data_length);
+						res = HAL_I2C_Master_Receive_DMA(b->trans.bus, b->trans.device_address8, b->trans.local_register_data, b->trans.data_length);
 						if (res != HAL_OK) {
 							LOG_ERROR(TAG, "HAL_I2C_Master_Receive_DMA failed");
-							this->trans.hal_i2c_error_code = this->trans.bus->ErrorCode;
-							this->trans.status = I2CEC_DMA_FAILED;
-							this->_state = I2CS_FINISH;
+							b->trans.hal_i2c_error_code = b->trans.bus->ErrorCode;
+							b->trans.status = I2CEC_DMA_FAILED;
+							b->state = I2CS_FINISH;
 						}
 						else {
-							this->_state = I2CS_READ_REG_WAIT_RCV;
+							b->state = I2CS_READ_REG_WAIT_RCV;
 						}
 
 					}
 					else { /* Unexpected response */
-						this->trans.hal_i2c_error_code = this->trans.bus->ErrorCode;
-						if (this->trans.hal_i2c_error_code == HAL_I2C_ERROR_AF) {
-							this->trans.status = I2CEC_NO_DEVICE;
+						b->trans.hal_i2c_error_code = b->trans.bus->ErrorCode;
+						if (b->trans.hal_i2c_error_code == HAL_I2C_ERROR_AF) {
+							b->trans.status = I2CEC_NO_DEVICE;
 						}
 						else {
-							this->trans.status = I2CEC_TRANS_FAILED;
+							b->trans.status = I2CEC_TRANS_FAILED;
 						}
-						this->_state = I2CS_FINISH;
+						b->state = I2CS_FINISH;
 					}
 				}
 
 				break;
 
 			case I2CS_READ_REG_WAIT_RCV: /* Wait for read data to be received */
-				if (this->_i2c_msg_ready) {
-					this->_i2c_msg_ready = false;
+				if (b->i2c_msg_ready) {
+					b->i2c_msg_ready = false;
 					if (this->_check_i2c_message(&msg, MSG_I2C_RX)) { /* Expected response */
 						//LOG_DEBUG(TAG,"I2C Read Register Complete");
-						this->trans.status = I2CEC_OK;
-						this->_state = I2CS_FINISH;
+						b->trans.status = I2CEC_OK;
+						b->state = I2CS_FINISH;
 						}
 					else { /* Unexpected response */
-						this->trans.hal_i2c_error_code = this->trans.bus->ErrorCode;
-						this->trans.status = I2CEC_TRANS_FAILED;
-						this->_state = I2CS_FINISH;
+						b->trans.hal_i2c_error_code = b->trans.bus->ErrorCode;
+						b->trans.status = I2CEC_TRANS_FAILED;
+						b->state = I2CS_FINISH;
 					}
 				}
 				break;
 
 
 			case I2CS_WRITE_REG: /* Start I2C register write */
-				this->_i2c_msg_ready = false;
+				b->i2c_msg_ready = false;
 				/* Send write register transaction */
 				/* Prepend register address and copy data to local buffer */
-				trans.local_register_data[0] = trans.register_address;
+				b->trans.local_register_data[0] = b->trans.register_address;
 
 				/* We write the register address and the data as one combined DMA transfer */
-				res = HAL_I2C_Master_Transmit_DMA(this->trans.bus, this->trans.device_address8, this->trans.local_register_data, this->trans.data_length + 1);
+				res = HAL_I2C_Master_Transmit_DMA(b->trans.bus, b->trans.device_address8, b->trans.local_register_data, b->trans.data_length + 1);
 				if (res != HAL_OK) {
 					LOG_ERROR(TAG, "HAL_I2C_Master_Transmit_DMA failed");
-					this->trans.hal_i2c_error_code = this->trans.bus->ErrorCode;
-					this->trans.status = I2CEC_DMA_FAILED;
-					this->_state = I2CS_FINISH;
+					b->trans.hal_i2c_error_code = b->trans.bus->ErrorCode;
+					b->trans.status = I2CEC_DMA_FAILED;
+					b->state = I2CS_FINISH;
 				}
 				else {
-					this->_state = I2CS_WRITE_REG_WAIT_DATA_XMIT;
+					b->state = I2CS_WRITE_REG_WAIT_DATA_XMIT;
 				}
 				break;
 
 			case I2CS_WRITE_REG_WAIT_DATA_XMIT: /* Wait for write data to be transmitted */
-				if (this->_i2c_msg_ready) {
-					this->_i2c_msg_ready = false;
+				if (b->i2c_msg_ready) {
+					b->i2c_msg_ready = false;
 					if (this->_check_i2c_message(&msg, MSG_I2C_TX)) { /* Expected response */
-						this->trans.status = I2CEC_OK;
-						this->_state = I2CS_FINISH;
+						b->trans.status = I2CEC_OK;
+						b->state = I2CS_FINISH;
 						}
 					else { /* Unexpected response */
-						this->trans.hal_i2c_error_code = this->trans.bus->ErrorCode;
-						if (this->trans.hal_i2c_error_code == HAL_I2C_ERROR_AF) {
-							this->trans.status = I2CEC_NO_DEVICE;
+						b->trans.hal_i2c_error_code = b->trans.bus->ErrorCode;
+						if (b->trans.hal_i2c_error_code == HAL_I2C_ERROR_AF) {
+							b->trans.status = I2CEC_NO_DEVICE;
 						}
 						else {
-							this->trans.status = I2CEC_TRANS_FAILED;
+							b->trans.status = I2CEC_TRANS_FAILED;
 						}
-						this->_state = I2CS_FINISH;
+						b->state = I2CS_FINISH;
 					}
 				}
 				break;
 
 			case I2CS_FINISH: /* Final steps */
+				/* After a bus error, the expander channel selection can't be trusted */
+				if((b->trans.status != I2CEC_OK) && (b->trans.status != I2CEC_DEADLINE_MISSED)) {
+					b->selected_channel = -1;
+				}
+
 				/* If OK and the command was a read */
-				if((this->trans.status == I2CEC_OK) && (this->trans.type == I2CT_READ_REG8)) {
+				if((b->trans.status == I2CEC_OK) && ((b->trans.op == I2CT_READ_REG8) || (b->trans.op == I2CT_READ_REG8_RS))) {
 					/* Copy the read data to the user's buffer pointer */
-					if(this->trans.read_data) {
-						memcpy(this->trans.read_data, this->trans.local_register_data, this->trans.data_length);
+					if(b->trans.read_data) {
+						memcpy(b->trans.read_data, b->trans.local_register_data, b->trans.data_length);
 					}
 				}
 
+				/* Run the next step of a chain without selecting the expander channel again */
+				if((b->trans.chain) && (b->trans.status == I2CEC_OK) && (++b->trans.chain_index < b->trans.chain_length)) {
+					b->state = I2CS_DO_REGISTER_RW;
+					break;
+				}
+
 				/* Call the user-supplied callback function if specified*/
-				if(this->trans.callback) {
-					(*this->trans.callback)(this->trans.type, this->trans.status, this->trans.id);
+				if(b->trans.callback) {
+					(*b->trans.callback)(b->trans.type, b->trans.status, b->trans.id);
 				}
 				/* Go back to Idle and look for more work */
-				this->_state = I2CS_IDLE;
+				b->state = I2CS_IDLE;
 				break;
 
 
 			default:
-				this->_state = I2CS_IDLE;
+				b->state = I2CS_IDLE;
 				break;
 		}
 	} /* End for(;;) */
@@ -423,19 +616,20 @@ void I2C_Engine::worker(void *args) {
  */
 
 void I2C_Engine::handler(I2C_HandleTypeDef *hi2c, uint32_t intr_type) {
-	uint8_t bus;
 	I2C_Queue_Message msg;
-	if (hi2c == &hi2c1) {
-		bus = 0;
-	}
-	else {
-		bus = 1;
+
+	/* Route the completion to the worker for the bus it came from */
+	for(uint8_t bus_num = 0; bus_num < NUM_I2C_BUSSES; bus_num++) {
+		I2C_Bus *b = &this->_busses[bus_num];
+		if(hi2c == b->handle) {
+			msg.bus = bus_num;
+			msg.type = intr_type;
+			msg.handle = hi2c;
+			osMessageQueuePut(b->queue_isr, &msg, 0U, 0U); /* Send message to the bus worker task */
+			osEventFlagsSet(b->event_flags, EVENT_FLAG_ISR);
+			return;
+		}
 	}
-	msg.bus = bus;
-	msg.type = intr_type;
-	msg.handle = hi2c;
-	osMessageQueuePut(this->_queue_i2c_busses, &msg, 0U, 0U); /* Send message to I2C task */
-	osEventFlagsSet(this->_event_flags, EVENT_FLAG_ISR);
 }
 
 
@@ -459,7 +459,7 @@ void MF_Decoder::init() {
 * Will return -1 if no receiver is available
 */
 
-int32_t MF_Decoder::seize(Mf_Callback callback, void *parameter, int channel, bool re_arm) {
+int32_t MF_Decoder::seize(Mf_Callback callback, void *parameter, int channel, bool re_arm, void *owner) {
 
 	int32_t descriptor;
 
@@ -468,39 +468,17 @@ int32_t MF_Decoder::seize(Mf_Callback callback, void *parameter, int channel, bo
 		POST_ERROR(Err_Handler::EH_NPFA);
 	}
 
+	if((channel < -1) || (channel >= NUM_MF_RECEIVERS)) {
+		POST_ERROR(Err_Handler::EH_IVR);
+	}
+
 	/* Get the lock */
 	osMutexAcquire(this->_lock, osWaitForever);
 
-	if(channel == -1) {
-		/* Auto select receiver */
-		for(descriptor = 0; descriptor < NUM_MF_RECEIVERS; descriptor++) {
-			/* Find an available receiver */
-			if((this->_rx_in_use_bits & (1 << descriptor)) == 0) {
-				this->_rx_in_use_bits |= (1 << descriptor);
-				break;
-			}
-		}
-	}
-	else if((channel > 0) || (channel < NUM_MF_RECEIVERS)) {
-		/* Manually select receiver */
-		if((this->_rx_in_use_bits & (1 << channel)) == 0) {
-			this->_rx_in_use_bits |= (1 << channel);
-			descriptor = (int32_t) channel;
-		}
-		else {
-			/* Receiver not available */
-			descriptor = NUM_MF_RECEIVERS;
-		}
-	}
-	else {
-		POST_ERROR(Err_Handler::EH_IVR);
-	}
+	/* The receiver busy bits are kept by the resource manager */
+	descriptor = Resource_mgr.allocate(Resource_Mgr::RT_MF_RECEIVER, channel, owner);
 
-	if(descriptor >= NUM_MF_RECEIVERS) {
-		/* No receiver available */
-		descriptor = -1;
-	}
-	else {
+	if(descriptor >= 0) {
 		/* Initialize the receiver */
 		this->_mf_data[descriptor].re_arm = re_arm;
 		this->_mf_data[descriptor].parameter = parameter;
@@ -538,9 +516,7 @@ void MF_Decoder::release(int32_t descriptor) {
 	/* Get the lock */
 	osMutexAcquire(this->_lock, osWaitForever);
 
-	if(this->_rx_in_use_bits & (1 << descriptor)) {
-		this->_rx_in_use_bits &= ~(1 << descriptor);
-
+	if(Resource_mgr.get_busy_bits(Resource_Mgr::RT_MF_RECEIVER) & (1 << descriptor)) {
 		/* De initialize MF receiver */
 		this->_stop_dma_transfers(descriptor);
 		this->_mf_data[descriptor].state = MFR_IDLE;
@@ -554,6 +530,9 @@ void MF_Decoder::release(int32_t descriptor) {
 	/* Release the lock */
 	osMutexRelease(this->_lock);
 
+	/* This may hand the receiver straight to a waiter */
+	Resource_mgr.release(Resource_Mgr::RT_MF_RECEIVER, descriptor);
+
 }
 
 /*
@@ -40,13 +40,23 @@ void Pool_Alloc::pool_init(void *memory_pool, uint32_t object_size, uint32_t num
 
 
 	/* Initialize the memory pool */
-	Utility.memset(memory_pool,0 , this->_block_size);
-	Free_Object_Type *current_object = reinterpret_cast<Free_Object_Type *>(memory_pool);
+	this->_init_free_list();
+}
+
+/*
+ * Initialize the free list.
+ *
+ * Every object in the pool is linked into the free list.
+ */
+
+void Pool_Alloc::_init_free_list(void) {
+	Utility.memset(this->_block_begin, 0 , this->_block_size);
+	Free_Object_Type *current_object = reinterpret_cast<Free_Object_Type *>(this->_block_begin);
 	/* Initialize next pointers up to num_objects - 1. The next field of the last block needs to have a NULL pointer in it. */
-	for(uint32_t index = 0; index < num_objects ; index++) {
-		if(index != num_objects - 1) { /* If not the last object */
+	for(uint32_t index = 0; index < this->_num_objects ; index++) {
+		if(index != this->_num_objects - 1) { /* If not the last object */
 			/* Set pointer to next object */
-			current_object->next = reinterpret_cast<Free_Object_Type *>(reinterpret_cast<uint8_t *>(current_object) + object_size);
+			current_object->next = reinterpret_cast<Free_Object_Type *>(reinterpret_cast<uint8_t *>(current_object) + this->_object_size);
 		}
 		/* Set the magic number to detect overwrites */
 		current_object->magic = ALLOC_MAGIC;
@@ -55,6 +65,22 @@ void Pool_Alloc::pool_init(void *memory_pool, uint32_t object_size, uint32_t num
 	}
 	/* Point to first object in block */
 	this->_alloc_ptr = this->_block_begin;
+	this->_objects_allocated = 0;
+}
+
+/*
+ * Return every object to the memory pool at once.
+ *
+ * The caller must guarantee no object allocated from the pool is still in use.
+ */
+
+void Pool_Alloc::pool_reset(void) {
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+
+	this->_init_free_list();
+
+	osMutexRelease(this->_lock); /* Release the lock */
 }
 
 /*
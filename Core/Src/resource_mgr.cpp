@@ -0,0 +1,553 @@
+#include "top.h"
+#include "logging.h"
+#include "err_handler.h"
+#include "util.h"
+#include "xps_logical.h"
+#include "tone_plant.h"
+#include "drv_dtmf.h"
+#include "mf_receiver.h"
+#include "resource_mgr.h"
+
+static const char *TAG = "resourcemgr";
+
+namespace Resource_Mgr {
+
+/*
+ * Return the pool for a resource type
+ */
+
+Resource_Pool *Resource_Mgr::_get_pool(uint32_t type) {
+	if(type >= NUM_RESOURCE_TYPES) {
+		POST_ERROR(Err_Handler::EH_IVD);
+	}
+	return &this->_pools[type];
+}
+
+/*
+ * Mark a free resource busy without taking the lock.
+ *
+ * Returns the index of the resource, or -1 if none (or not the one requested) is free.
+ */
+
+int32_t Resource_Mgr::_take(Resource_Pool *pool, int32_t requested) {
+	uint32_t busy = __atomic_load_n(&pool->busy_bits, __ATOMIC_ACQUIRE);
+
+	for(;;) {
+		uint32_t bit;
+		if(requested == -1) {
+			uint32_t free_bits = ~busy & pool->mask;
+			if(!free_bits) {
+				return -1;
+			}
+			bit = free_bits & -free_bits; /* Lowest free resource */
+		}
+		else {
+			bit = (1 << requested);
+			if(busy & bit) {
+				return -1;
+			}
+		}
+		/* On failure, busy is updated with the current value and the search is repeated */
+		if(__atomic_compare_exchange_n(&pool->busy_bits, &busy, busy | bit, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			return __builtin_ctz(bit);
+		}
+	}
+}
+
+/*
+ * Mark a busy or reserved resource free.
+ *
+ * Must be called with the lock held.
+ */
+
+void Resource_Mgr::_free(Resource_Pool *pool, int32_t index) {
+	uint32_t bit = (1 << index);
+
+	if((__atomic_load_n(&pool->busy_bits, __ATOMIC_ACQUIRE) & bit) == 0) {
+		POST_ERROR(Err_Handler::EH_FRAA);
+	}
+	__atomic_fetch_and(&pool->reserved_bits, ~bit, __ATOMIC_ACQ_REL);
+	pool->owners[index] = NULL;
+	__atomic_fetch_and(&pool->busy_bits, ~bit, __ATOMIC_ACQ_REL);
+	__atomic_fetch_sub(&pool->stats.in_use, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Update the statistics for a resource which was marked busy
+ */
+
+void Resource_Mgr::_count_grant(Resource_Pool *pool) {
+	__atomic_fetch_add(&pool->stats.grants, 1, __ATOMIC_RELAXED);
+	uint32_t in_use = __atomic_add_fetch(&pool->stats.in_use, 1, __ATOMIC_RELAXED);
+	if(in_use > pool->stats.peak_in_use) {
+		pool->stats.peak_in_use = in_use;
+	}
+}
+
+/*
+ * Called once after the RTOS is up and running
+ */
+
+void Resource_Mgr::init(void) {
+	static const osMutexAttr_t resource_mgr_mutex_attr = {
+		"ResourceMgrMutex",
+		osMutexRecursive | osMutexPrioInherit,
+		NULL,
+		0U
+	};
+	static const uint32_t pool_sizes[NUM_RESOURCE_TYPES] = {
+		XPS_Logical::MAX_JUNCTORS,
+		Tone_Plant::NUM_TONE_OUTPUTS,
+		Dtmf::NUM_DTMF_RECEIVERS,
+		MF_Decoder::NUM_MF_RECEIVERS
+	};
+
+	Utility.memset(this->_pools, 0, sizeof(this->_pools));
+	this->_waiter_count = 0;
+	for(uint32_t type = 0; type < NUM_RESOURCE_TYPES; type++) {
+		if(pool_sizes[type] > MAX_RESOURCES_PER_TYPE) {
+			POST_ERROR(Err_Handler::EH_NMA);
+		}
+		this->_pools[type].mask = (pool_sizes[type] == 32) ? 0xFFFFFFFF : ((1UL << pool_sizes[type]) - 1);
+	}
+
+	this->_lock = osMutexNew(&resource_mgr_mutex_attr);
+	if(this->_lock == NULL) {
+		POST_ERROR(Err_Handler::EH_LCE);
+	}
+}
+
+/*
+ * Allocate a resource.
+ *
+ * If requested is -1, the lowest numbered free resource is allocated, else
+ * the requested resource is allocated if it is free, or if it was reserved for owner.
+ * A reserved resource can't be taken by anyone else, including callers passing no owner.
+ * Nothing else is handed out while waiters are queued for the type, so a caller which
+ * bypasses reserve() can't take a resource freed for a waiter.
+ *
+ * Returns the index of the resource allocated, or -1 if none is available.
+ */
+
+int32_t Resource_Mgr::allocate(uint32_t type, int32_t requested, void *owner) {
+	Resource_Pool *pool = this->_get_pool(type);
+	int32_t index;
+
+	if((requested < -1) || ((requested >= 0) && (((1UL << requested) & pool->mask) == 0))) {
+		POST_ERROR(Err_Handler::EH_IVD);
+	}
+
+	bool waiters = (__atomic_load_n(&pool->stats.waiting, __ATOMIC_ACQUIRE) != 0);
+
+	if(requested == -1) {
+		/* Reserved resources are busy, so they are never picked here */
+		index = (waiters) ? -1 : this->_take(pool, -1);
+	}
+	else {
+		uint32_t bit = (1 << requested);
+
+		osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+		if(__atomic_load_n(&pool->reserved_bits, __ATOMIC_ACQUIRE) & bit) {
+			if(owner && (pool->owners[requested] == owner)) {
+				/* Claim the reservation. The resource is already busy and counted. */
+				__atomic_fetch_and(&pool->reserved_bits, ~bit, __ATOMIC_ACQ_REL);
+				pool->owners[requested] = NULL;
+				osMutexRelease(this->_lock); /* Release the lock */
+				return requested;
+			}
+			index = -1;
+		}
+		else {
+			index = (waiters) ? -1 : this->_take(pool, requested);
+		}
+		osMutexRelease(this->_lock); /* Release the lock */
+	}
+
+	if(index < 0) {
+		__atomic_fetch_add(&pool->stats.failures, 1, __ATOMIC_RELAXED);
+	}
+	else {
+		this->_count_grant(pool);
+	}
+	return index;
+}
+
+/*
+ * Take one of each resource type in a mask, or none at all, and reserve them for owner.
+ *
+ * Must be called with the lock held.
+ */
+
+bool Resource_Mgr::_take_bundle(uint32_t type_mask, Resource_Bundle &bundle, void *owner) {
+	uint32_t type;
+
+	for(type = 0; type < NUM_RESOURCE_TYPES; type++) {
+		bundle.index[type] = -1;
+	}
+
+	for(type = 0; type < NUM_RESOURCE_TYPES; type++) {
+		if(!(type_mask & (1 << type))) {
+			continue;
+		}
+		int32_t index = this->_take(&this->_pools[type], -1);
+		if(index < 0) {
+			break;
+		}
+		bundle.index[type] = index;
+	}
+
+	if(type < NUM_RESOURCE_TYPES) {
+		/* Something wasn't free. Put back what was taken. */
+		for(uint32_t i = 0; i < type; i++) {
+			if(bundle.index[i] >= 0) {
+				__atomic_fetch_and(&this->_pools[i].busy_bits, ~(1UL << bundle.index[i]), __ATOMIC_ACQ_REL);
+				bundle.index[i] = -1;
+			}
+		}
+		return false;
+	}
+
+	for(type = 0; type < NUM_RESOURCE_TYPES; type++) {
+		if(bundle.index[type] >= 0) {
+			this->_count_grant(&this->_pools[type]);
+			this->_pools[type].owners[bundle.index[type]] = owner;
+			__atomic_fetch_or(&this->_pools[type].reserved_bits, (1UL << bundle.index[type]), __ATOMIC_ACQ_REL);
+		}
+	}
+	return true;
+}
+
+/*
+ * Update the queue depth statistics of each type in a mask
+ *
+ * Must be called with the lock held.
+ */
+
+void Resource_Mgr::_count_waiting(uint32_t type_mask, bool add) {
+	for(uint32_t type = 0; type < NUM_RESOURCE_TYPES; type++) {
+		if(!(type_mask & (1 << type))) {
+			continue;
+		}
+		Resource_Stats *stats = &this->_pools[type].stats;
+		if(add) {
+			stats->waits++;
+			stats->waiting++;
+			if(stats->waiting > stats->peak_waiting) {
+				stats->peak_waiting = stats->waiting;
+			}
+		}
+		else if(stats->waiting) {
+			stats->waiting--;
+		}
+	}
+}
+
+/*
+ * Remove a waiter from the queue, keeping the order of the remaining waiters
+ *
+ * Must be called with the lock held.
+ */
+
+void Resource_Mgr::_remove_waiter(uint32_t i) {
+	for(; i + 1 < this->_waiter_count; i++) {
+		this->_waiters[i] = this->_waiters[i + 1];
+	}
+	this->_waiter_count--;
+}
+
+/*
+ * Reserve one of each resource type in a mask, all or nothing, or join the queue of waiters.
+ *
+ * If all are free, they are reserved, their indexes are returned in the bundle and true is returned.
+ * The caller claims each one by allocating it with its index and data as the owner (normally through
+ * the seize method of the owning module).
+ *
+ * If not, nothing is held, the caller is queued and false is returned. Waiters are served highest
+ * priority first, then oldest first. When a release makes a waiter's whole bundle available, it is
+ * reserved for the waiter under the lock and the callback is called. Calling again while queued returns
+ * false until then, and afterwards collects the bundle, removes the waiter and returns true.
+ *
+ * A request never takes a type which an earlier or higher priority waiter still needs,
+ * so a waiter which needs several resources can't be starved by smaller requests.
+ */
+
+bool Resource_Mgr::reserve(uint32_t type_mask, Resource_Bundle &bundle, Resource_Grant_Callback callback, void *data, uint32_t priority) {
+	uint32_t blocked = 0;
+	uint32_t i;
+
+	if(!callback) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+	if((type_mask == 0) || (type_mask >= (1 << NUM_RESOURCE_TYPES)) || (priority > RP_HIGH)) {
+		POST_ERROR(Err_Handler::EH_IVD);
+	}
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+
+	/* Already waiting? */
+	for(i = 0; i < this->_waiter_count; i++) {
+		Resource_Waiter *w = &this->_waiters[i];
+		if(w->data == data) {
+			if(!w->granted) {
+				osMutexRelease(this->_lock); /* Release the lock */
+				return false;
+			}
+			/* Collect the bundle reserved for the waiter */
+			bundle = w->bundle;
+			this->_remove_waiter(i);
+			osMutexRelease(this->_lock); /* Release the lock */
+			return true;
+		}
+		/* A granted waiter holds its resources already */
+		if(!w->granted && (w->priority >= priority)) {
+			blocked |= w->type_mask;
+		}
+	}
+
+	if(!(type_mask & blocked) && this->_take_bundle(type_mask, bundle, data)) {
+		osMutexRelease(this->_lock); /* Release the lock */
+		return true;
+	}
+
+	if(this->_waiter_count >= MAX_WAITERS) {
+		POST_ERROR(Err_Handler::EH_NORC);
+	}
+
+	for(uint32_t type = 0; type < NUM_RESOURCE_TYPES; type++) {
+		if(type_mask & (1 << type)) {
+			this->_pools[type].stats.failures++;
+		}
+	}
+
+	/* Insert behind all waiters of the same or higher priority */
+	for(i = this->_waiter_count; (i > 0) && (this->_waiters[i - 1].priority < priority); i--) {
+		this->_waiters[i] = this->_waiters[i - 1];
+	}
+	Resource_Waiter *waiter = &this->_waiters[i];
+	waiter->callback = callback;
+	waiter->data = data;
+	waiter->start_time = osKernelGetTickCount();
+	waiter->type_mask = type_mask;
+	waiter->priority = priority;
+	waiter->granted = false;
+	this->_waiter_count++;
+	this->_count_waiting(type_mask, true);
+
+	osMutexRelease(this->_lock); /* Release the lock */
+
+	return false;
+}
+
+/*
+ * Find the first waiter in the queue whose resources are all free, and reserve them for it.
+ *
+ * The bundle is recorded in the waiter, which stays queued until it collects it with reserve()
+ * or gives it up with cancel_wait(). Returns true, with a copy of the waiter, if one was found.
+ * Must be called with the lock held.
+ */
+
+bool Resource_Mgr::_grant_next(Resource_Waiter &waiter) {
+	uint32_t blocked = 0;
+
+	for(uint32_t i = 0; i < this->_waiter_count; i++) {
+		Resource_Waiter *w = &this->_waiters[i];
+
+		if(w->granted) {
+			continue;
+		}
+
+		if((w->type_mask & blocked) || !this->_take_bundle(w->type_mask, w->bundle, w->data)) {
+			/* Later waiters may not take what this one is waiting for */
+			blocked |= w->type_mask;
+			continue;
+		}
+
+		w->granted = true;
+		this->_count_waiting(w->type_mask, false);
+
+		uint32_t wait_time = osKernelGetTickCount() - w->start_time;
+		for(uint32_t type = 0; type < NUM_RESOURCE_TYPES; type++) {
+			if(w->bundle.index[type] < 0) {
+				continue;
+			}
+			Resource_Stats *stats = &this->_pools[type].stats;
+			stats->handoffs++;
+			stats->total_wait_time += wait_time;
+			if(wait_time > stats->max_wait_time) {
+				stats->max_wait_time = wait_time;
+			}
+		}
+		waiter = *w;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Grant resources to waiters until no more can be served.
+ *
+ * Callbacks are called without the lock so the waiter can call back in.
+ */
+
+void Resource_Mgr::_serve_waiters(void) {
+	Resource_Waiter waiter;
+
+	for(;;) {
+		osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+		bool granted = this->_grant_next(waiter);
+		osMutexRelease(this->_lock); /* Release the lock */
+
+		if(!granted) {
+			break;
+		}
+		LOG_DEBUG(TAG, "Resource mask %02X granted to a waiter", (unsigned) waiter.type_mask);
+		(*waiter.callback)(waiter.data);
+	}
+}
+
+/*
+ * Release a resource.
+ *
+ * An unclaimed reservation is released the same way. Any waiter which can now be served is.
+ */
+
+void Resource_Mgr::release(uint32_t type, int32_t index) {
+	Resource_Pool *pool = this->_get_pool(type);
+
+	if((index < 0) || (((1UL << index) & pool->mask) == 0)) {
+		POST_ERROR(Err_Handler::EH_IVD);
+	}
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+	this->_free(pool, index);
+	bool waiters = (this->_waiter_count != 0);
+	osMutexRelease(this->_lock); /* Release the lock */
+
+	if(waiters) {
+		this->_serve_waiters();
+	}
+}
+
+/*
+ * Release the resources in a bundle which haven't been claimed, and mark them released.
+ *
+ * Claimed resources must be removed from the bundle by the caller.
+ */
+
+void Resource_Mgr::release_reserved(Resource_Bundle &bundle) {
+	for(uint32_t type = 0; type < NUM_RESOURCE_TYPES; type++) {
+		if(bundle.index[type] >= 0) {
+			this->release(type, bundle.index[type]);
+			bundle.index[type] = -1;
+		}
+	}
+}
+
+/*
+ * Release everything still reserved for an owner.
+ *
+ * This includes resources taken out of a bundle whose seize then failed, which
+ * release_reserved() can no longer see.
+ */
+
+void Resource_Mgr::release_owned(void *owner) {
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+
+	for(uint32_t type = 0; type < NUM_RESOURCE_TYPES; type++) {
+		Resource_Pool *pool = &this->_pools[type];
+		uint32_t reserved = __atomic_load_n(&pool->reserved_bits, __ATOMIC_ACQUIRE);
+		while(reserved) {
+			int32_t index = __builtin_ctz(reserved);
+			reserved &= reserved - 1;
+			if(pool->owners[index] == owner) {
+				this->_free(pool, index);
+			}
+		}
+	}
+	bool waiters = (this->_waiter_count != 0);
+
+	osMutexRelease(this->_lock); /* Release the lock */
+
+	if(waiters) {
+		this->_serve_waiters();
+	}
+}
+
+/*
+ * Remove a waiter from the queue.
+ *
+ * If a bundle was already reserved for the waiter and not collected, it is released.
+ * Returns true if that happened.
+ */
+
+bool Resource_Mgr::cancel_wait(void *data) {
+	bool granted = false;
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+
+	for(uint32_t i = 0; i < this->_waiter_count; i++) {
+		Resource_Waiter *w = &this->_waiters[i];
+		if(w->data == data) {
+			if(w->granted) {
+				for(uint32_t type = 0; type < NUM_RESOURCE_TYPES; type++) {
+					if(w->bundle.index[type] >= 0) {
+						this->_free(&this->_pools[type], w->bundle.index[type]);
+					}
+				}
+				granted = true;
+			}
+			else {
+				this->_count_waiting(w->type_mask, false);
+			}
+			this->_remove_waiter(i);
+			break;
+		}
+	}
+
+	osMutexRelease(this->_lock); /* Release the lock */
+
+	/* Waiters blocked behind the one removed, or needing what it held, may now be served */
+	this->_serve_waiters();
+
+	return granted;
+}
+
+/*
+ * Return a bit map of the busy resources of a type
+ */
+
+uint32_t Resource_Mgr::get_busy_bits(uint32_t type) {
+	return __atomic_load_n(&this->_get_pool(type)->busy_bits, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Return a copy of the statistics for a resource type
+ */
+
+void Resource_Mgr::get_stats(uint32_t type, Resource_Stats &stats) {
+	Resource_Pool *pool = this->_get_pool(type);
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+	stats = pool->stats;
+	osMutexRelease(this->_lock); /* Release the lock */
+}
+
+/*
+ * Clear the statistics for a resource type. The current occupancy is kept.
+ */
+
+void Resource_Mgr::clear_stats(uint32_t type) {
+	Resource_Pool *pool = this->_get_pool(type);
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+	uint32_t in_use = pool->stats.in_use;
+	uint32_t waiting = pool->stats.waiting;
+	Utility.memset(&pool->stats, 0, sizeof(pool->stats));
+	pool->stats.in_use = pool->stats.peak_in_use = in_use;
+	pool->stats.waiting = pool->stats.peak_waiting = waiting;
+	osMutexRelease(this->_lock); /* Release the lock */
+}
+
+} /* End namespace Resource_Mgr */
+
+Resource_Mgr::Resource_Mgr Resource_mgr;
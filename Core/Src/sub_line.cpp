@@ -8,6 +8,7 @@
 #include "drv_dtmf.h"
 #include "connector.h"
 #include "sub_line.h"
+#include "event.h"
 
 namespace Sub_Line {
 
@@ -46,6 +47,7 @@ void Sub_Line::_tone_complete_callback(uint32_t channel_number, void *data) {
 	switch(linfo->state) {
 	case LS_WAIT_FOR_DR_SAMPLE:
 		linfo->state = LS_CALL_SETUP;
+		this->_post_event(linfo->phys_line_trunk_number);
 		break;
 
 	default:
@@ -71,6 +73,7 @@ void Sub_Line::_digit_receiver_callback(int32_t descriptor, char digit, uint32_t
 	if(linfo->num_dialed_digits < Connector::MAX_DIALED_DIGITS) {
 		linfo->digit_buffer[linfo->num_dialed_digits++] = digit;
 		linfo->digit_buffer[linfo->num_dialed_digits] = 0;
+		this->_post_event(parameter);
 	}
 }
 
@@ -113,6 +116,7 @@ void Sub_Line::_dial_timer_callback(void *arg) {
 
 
 	}
+	this->_post_event(linfo->phys_line_trunk_number);
 	osMutexRelease(this->_lock); /* Release the lock */
 }
 
@@ -138,8 +142,6 @@ void Sub_Line::event_handler(uint32_t event_type, uint32_t resource) {
 			break; /* Ignore in idle state */
 
 		case LS_SEIZE_JUNCTOR: /* Calling party perspective */
-		case LS_SEIZE_TG:
-		case LS_SEIZE_DTMFR:
 		case LS_WAIT_FIRST_DIGIT:
 		case LS_WAIT_ROUTE:
 		case LS_TEST_FOR_DR_SAMPLE:
@@ -170,7 +172,6 @@ void Sub_Line::event_handler(uint32_t event_type, uint32_t resource) {
 
 		/* Calling party hung up*/
 		case LS_ORIG_DISCONNECT:
-		case LS_ORIG_DISCONNECT_B:
 		case LS_ORIG_DISCONNECT_C:
 		case LS_ORIG_DISCONNECT_D:
 		case LS_ORIG_DISCONNECT_F:
@@ -195,10 +196,11 @@ void Sub_Line::event_handler(uint32_t event_type, uint32_t resource) {
 
 	}
 	else if (event_type == EV_ANSWERED) { /* Called subscriber perspective */
-		if((linfo->state == LS_RING) || (linfo->state = LS_RINGING)) {
+		if((linfo->state == LS_RING) || (linfo->state == LS_RINGING)) {
 			linfo->state = LS_ANSWER;
 		}
 	}
+	this->_post_event(resource);
 	osMutexRelease(this->_lock); /* Release the lock */
 
 
@@ -273,14 +275,24 @@ uint32_t Sub_Line::peer_message_handler(Connector::Conn_Info *conn_info, uint32_
 		break;
 
 	case Connector::PM_TRUNK_BUSY:
-		if((linfo->state == LS_WAIT_TRUNK_RESPONSE)) {
+		if(linfo->cut_through == Connector::CT_SEIZED) {
+			/* Trunk seized while dialing was busy, advance once the route is valid */
+			LOG_INFO(TAG, "Cut-through trunk busy returned by PM");
+			linfo->cut_through = Connector::CT_FAILED;
+		}
+		else if((linfo->state == LS_WAIT_TRUNK_RESPONSE)) {
 			LOG_INFO(TAG, "Trunk busy returned by PM");
 			linfo->state = LS_TRUNK_ADVANCE;
 		}
 		break;
 
 	case Connector::PM_TRUNK_NO_WINK:
-		if((linfo->state == LS_WAIT_TRUNK_RESPONSE)) {
+		if(linfo->cut_through == Connector::CT_SEIZED) {
+			uint32_t dest_trunk_number = Conn.get_called_phys_line_trunk(linfo);
+			LOG_WARN(TAG, "No wink seen on cut-through trunk: %u", dest_trunk_number);
+			linfo->cut_through = Connector::CT_FAILED;
+		}
+		else if((linfo->state == LS_WAIT_TRUNK_RESPONSE)) {
 				uint32_t dest_trunk_number = Conn.get_called_phys_line_trunk(linfo);
 				LOG_WARN(TAG, "No wink seen on trunk: %u", dest_trunk_number);
 				linfo->state = LS_TRUNK_ADVANCE;
@@ -288,7 +300,11 @@ uint32_t Sub_Line::peer_message_handler(Connector::Conn_Info *conn_info, uint32_
 		break;
 
 	case Connector::PM_TRUNK_READY_FOR_ADDR_INFO:
-		if((linfo->state == LS_WAIT_TRUNK_RESPONSE) || (linfo->state = LS_TRUNK_ADVANCE)) {
+		if(linfo->cut_through == Connector::CT_SEIZED) {
+			/* Trunk winked while the caller is still dialing, the address is sent when the route is valid */
+			linfo->cut_through = Connector::CT_READY;
+		}
+		else if((linfo->state == LS_WAIT_TRUNK_RESPONSE) || (linfo->state == LS_TRUNK_ADVANCE)) {
 			linfo->state = LS_TRUNK_SEND_ADDR_INFO;
 		}
 		break;
@@ -303,6 +319,7 @@ uint32_t Sub_Line::peer_message_handler(Connector::Conn_Info *conn_info, uint32_
 		LOG_ERROR(TAG, "Bad parameter value, message: %d, line_state: %d, line number: %d", message, linfo->state, phys_line_trunk_number);
 		break;
 	}
+	this->_post_event(phys_line_trunk_number);
 	return res;
 }
 
@@ -337,6 +354,8 @@ void Sub_Line::init(void) {
 		linfo->phys_line_trunk_number = index;
 		linfo->state = LS_IDLE;
 		linfo->tone_plant_descriptor = linfo->mf_receiver_descriptor = linfo->dtmf_receiver_descriptor = -1;
+		Conn.init_resources(linfo);
+		linfo->cut_through = Connector::CT_NONE;
 	}
 }
 
@@ -353,14 +372,82 @@ void Sub_Line::config(void) {
 
 
 /*
- * Polling
+ * Post an event for a line.
+ *
+ * Marks the line as having work to do and wakes the event worker.
+ * The line will be serviced on the next pass of the worker.
+ *
+ * Takes no lock, as it is called from tone plant, DTMF and resource manager callbacks
+ * which may hold their own locks while poll() holds ours and calls into them.
+ */
+
+void Sub_Line::_post_event(uint32_t line) {
+	if(line >= (MAX_DUAL_LINE_CARDS * 2)) {
+		POST_ERROR(Err_Handler::EH_IPLN);
+	}
+	__atomic_fetch_or(&this->_pending_lines, (1UL << line), __ATOMIC_ACQ_REL);
+
+	Event_handler.wake();
+}
+
+/*
+ * Wake a line waiting for a resource
+ */
+
+void Sub_Line::wake(uint32_t line) {
+	this->_post_event(line);
+}
+
+
+/*
+ * Called by the event worker.
+ *
+ * Services every line which has a pending event. On a timer tick, lines which are not idle
+ * are also serviced so that resource seizure retries get another chance to run.
+ *
+ * A line is stepped until its state stops changing, so that a chain of
+ * transitions completes in the same pass instead of one transition per tick.
  */
 
-void Sub_Line::poll(void) {
+void Sub_Line::poll(bool tick) {
 	osMutexAcquire(this->_lock, osWaitForever); /*Get the lock */
 
+	for(uint32_t pass = 0; pass < MAX_SERVICE_PASSES; pass++) {
+		uint32_t pending = __atomic_exchange_n(&this->_pending_lines, 0, __ATOMIC_ACQ_REL);
+
+		for(uint8_t line = 0; line < MAX_DUAL_LINE_CARDS * 2; line++) {
+			Connector::Conn_Info *linfo = &this->_conn_info[line];
+
+			if(!(pending & (1 << line)) && !(tick && (linfo->state != LS_IDLE))) {
+				continue;
+			}
+
+			for(uint32_t step = 0; step < MAX_SERVICE_STEPS; step++) {
+				uint32_t prev_state = linfo->state;
+				this->_service(line);
+				if(linfo->state == prev_state) {
+					break;
+				}
+			}
+		}
+		/* Only run again if servicing a line posted an event for another line */
+		if(!__atomic_load_n(&this->_pending_lines, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+		tick = false;
+	}
+
+	osMutexRelease(this->_lock); /* Release the lock */
+}
 
-	Connector::Conn_Info *linfo = &this->_conn_info[this->_line_to_service];
+
+/*
+ * Run the state machine for one line
+ */
+
+void Sub_Line::_service(uint8_t line) {
+
+	Connector::Conn_Info *linfo = &this->_conn_info[line];
 
 	switch(linfo->state) {
 	case LS_IDLE:
@@ -371,43 +458,42 @@ void Sub_Line::poll(void) {
 	 * Caller perspective
 	 */
 
+	/*
+	 * The junctor, tone generator and DTMF receiver are reserved together through the resource manager.
+	 * If they aren't all free, nothing is held, and the line is queued and woken when they are reserved for it.
+	 * The whole set is then claimed at once. If a claim fails anyway, everything is given up and reserved again.
+	 */
+
 	case LS_SEIZE_JUNCTOR: /* Caller perspective */
-		if(Xps_logical.seize(&linfo->jinfo)) {
-				Conn.prepare(linfo, Connector::ET_LINE, this->_line_to_service);
-				linfo->junctor_seized = true;
-				linfo->state = LS_SEIZE_TG;
+		if(Conn.reserve_resources(linfo, Resource_Mgr::RM_JUNCTOR | Resource_Mgr::RM_TONE_CHANNEL | Resource_Mgr::RM_DTMF_RECEIVER,
+				Resource_Mgr::RP_NORMAL)) {
+			linfo->junctor_seized = Xps_logical.seize(&linfo->jinfo, Conn.claim_resource(linfo, Resource_Mgr::RT_JUNCTOR), linfo);
+			linfo->tone_plant_descriptor = Tone_plant.channel_seize(Conn.claim_resource(linfo, Resource_Mgr::RT_TONE_CHANNEL), linfo);
+			linfo->dtmf_receiver_descriptor = Dtmf_receivers.seize(__digit_receiver_callback, line,
+					Conn.claim_resource(linfo, Resource_Mgr::RT_DTMF_RECEIVER), linfo);
+			if(!linfo->junctor_seized || (linfo->tone_plant_descriptor < 0) || (linfo->dtmf_receiver_descriptor < 0)) {
+				Conn.abandon_resources(linfo);
+				break;
 			}
-		break;
-
-
-	case LS_SEIZE_TG: /* Caller perspective */
-		if((linfo->tone_plant_descriptor = Tone_plant.channel_seize()) > -1) {
-			linfo->state = LS_SEIZE_DTMFR;
-		}
-		break;
-
-
-	case LS_SEIZE_DTMFR: /* Caller perspective */
-		if((linfo->dtmf_receiver_descriptor = Dtmf_receivers.seize(__digit_receiver_callback, this->_line_to_service)) > -1) {
-			/* Connect phone to junctor */
-			Xps_logical.connect_phone_orig(&linfo->jinfo, this->_line_to_service);
-			/* Connect DTMF receiver to junctor */
+			Conn.prepare(linfo, Connector::ET_LINE, line);
+			/* Connect phone, DTMF receiver and tone generator to junctor in one batch */
+			Xps_logical.begin();
+			Xps_logical.connect_phone_orig(&linfo->jinfo, line);
 			Xps_logical.connect_dtmf_receiver(&linfo->jinfo, linfo->dtmf_receiver_descriptor);
+			Xps_logical.connect_tone_plant_output(&linfo->jinfo, linfo->tone_plant_descriptor);
+			Xps_logical.commit();
 			/* Clear digit buffer */
 			linfo->num_dialed_digits = 0;
 			linfo->digit_buffer[0] = 0;
-			/* Connect tone generator to junctor */
-			Xps_logical.connect_tone_plant_output(&linfo->jinfo, linfo->tone_plant_descriptor);
 			/* Send Dial tone */
 			Conn.send_dial_tone(linfo->tone_plant_descriptor);
 			/* Tell the line on the line card that the OR is connected */
 			/* For future dial pulse support */
-			Card_comm.send_command(Card_Comm::RT_LINE, this->_line_to_service, REG_SET_OR_ATTACHED);
+			Card_comm.send_command(Card_Comm::RT_LINE, line, REG_SET_OR_ATTACHED, 0, Card_Comm::CP_URGENT);
 			/* Start the dial timer */
 			osTimerStart(linfo->dial_timer, DTMF_DIGIT_DIAL_TIME);
 			linfo->state = LS_WAIT_FIRST_DIGIT;
 		}
-
 		break;
 
 	case LS_WAIT_FIRST_DIGIT: /* Caller perspective */
@@ -438,10 +524,14 @@ void Sub_Line::poll(void) {
 
 		case Connector::ROUTE_INDETERMINATE:
 			/* Don't have all the necessary dialed digits yet */
+			/* If only one trunk group can be reached, seize a trunk while the caller keeps dialing */
+			Conn.seize_trunk_early(linfo, linfo->digit_buffer);
 			break;
 
 		case Connector::ROUTE_INVALID:
 		default:
+			/* Release any trunk seized for cut-through dialing */
+			Conn.cancel_cut_through(linfo);
 			/* Release DTMF Receiver */
 			Conn.release_dtmf_receiver(linfo);
 			/* Send congestion */
@@ -489,6 +579,22 @@ void Sub_Line::poll(void) {
 
 
 	case LS_CALL_SETUP: /* Caller perspective */
+		/* Pick up from where a trunk seized during dialing got to */
+		if(linfo->cut_through != Connector::CT_NONE) {
+			if(linfo->cut_through == Connector::CT_READY) {
+				/* Wink already seen */
+				linfo->state = LS_TRUNK_SEND_ADDR_INFO;
+			}
+			else if(linfo->cut_through == Connector::CT_SEIZED) {
+				linfo->state = LS_WAIT_TRUNK_RESPONSE;
+			}
+			else {
+				/* Trunk was busy or didn't wink */
+				linfo->state = LS_TRUNK_ADVANCE;
+			}
+			linfo->cut_through = Connector::CT_NONE;
+			break;
+		}
 		/* Resolve the call */
 		switch(Conn.resolve(linfo)) {
 
@@ -536,7 +642,7 @@ void Sub_Line::poll(void) {
 		uint32_t res = Conn.resolve_try_next_trunk(linfo);
 		switch(res) {
 		case Connector::ROUTE_DEST_TRUNK_BUSY:
-			LOG_DEBUG(TAG, "Trunk busy after trunk advance");
+			/* Logged on entry to the state, not on every retry */
 			break; /* This trunk is busy, try again later */
 
 		case Connector::ROUTE_NO_MORE_TRUNKS:
@@ -561,9 +667,11 @@ void Sub_Line::poll(void) {
 
 	case LS_TRUNK_SEND_ADDR_INFO: { /* Caller perspective */
 		/* Release the tone generator as we don't need it now */
+		Xps_logical.begin();
 		Conn.release_tone_generator(linfo);
 		/* Temporarily disconnect the caller from the junctor */
 		Conn.disconnect_caller_party_audio(linfo);
+		Xps_logical.commit();
 		/* Everything should be off of the junctor now */
 		/* Prepare the address info */
 		uint8_t start = linfo->route_info.dest_dial_start_index + 1;
@@ -607,6 +715,8 @@ void Sub_Line::poll(void) {
 
 
 	case LS_DIAL_TIMEOUT:
+		/* Release any trunk seized for cut-through dialing */
+		Conn.cancel_cut_through(linfo);
 		/* Release DTMF Receiver */
 		Conn.release_dtmf_receiver(linfo);
 		/* Stop dial tone generation */
@@ -662,11 +772,13 @@ void Sub_Line::poll(void) {
 		uint8_t et = Conn.get_called_equip_type(linfo);
 		/* If called party is a line on this exchange */
 		if(et == Connector::ET_LINE) {
-			Conn.release_tone_generator(linfo);
 			/* Send in call state to line card */
-			Card_comm.send_command(Card_Comm::RT_LINE, this->_line_to_service, REG_SET_IN_CALL);
-			/* Connect audio path */
+			Card_comm.send_command(Card_Comm::RT_LINE, line, REG_SET_IN_CALL, 0, Card_Comm::CP_URGENT);
+			/* Swap the tone generator for the called party audio path */
+			Xps_logical.begin();
+			Conn.release_tone_generator(linfo);
 			Conn.connect_called_party_audio(linfo);
+			Xps_logical.commit();
 		}
 
 		linfo->state = LS_WAIT_END_CALL;
@@ -680,7 +792,7 @@ void Sub_Line::poll(void) {
 
 	case LS_FAR_END_DISCONNECT: /* Caller perspective */
 		/* Re-acquire a tone generator */
-		if((linfo->tone_plant_descriptor = Tone_plant.channel_seize()) > -1) {
+		if((linfo->tone_plant_descriptor = Conn.seize_tone_generator(linfo)) > -1) {
 				linfo->state = LS_FAR_END_DISCONNECT_B;
 			}
 		break;
@@ -714,7 +826,7 @@ void Sub_Line::poll(void) {
 
 	case LS_RING: /* Called perspective */
 		/* Tell the SLIC to start ringing */
-		Card_comm.send_command(Card_Comm::RT_LINE, this->_line_to_service, REG_REQUEST_RINGING);
+		Card_comm.send_command(Card_Comm::RT_LINE, line, REG_REQUEST_RINGING, 0, Card_Comm::CP_URGENT);
 		linfo->state = LS_RINGING;
 		break;
 
@@ -749,25 +861,25 @@ void Sub_Line::poll(void) {
 		/* then we send end call */
 		/* Seize a junctor */
 
-		if(Xps_logical.seize(&linfo->jinfo)) {
-			Conn.prepare(linfo, Connector::ET_LINE, this->_line_to_service);
-			linfo->junctor_seized = true;
-			linfo->state = LS_ORIG_DISCONNECT_B;
-		}
-		break;
-
-	case LS_ORIG_DISCONNECT_B: /* Called perspective */
-		/* Seize a tone generator */
-		if((linfo->tone_plant_descriptor = Tone_plant.channel_seize()) > -1) {
+		/* The tone generator is reserved with it, and both are claimed at once */
+		if(Conn.reserve_resources(linfo, Resource_Mgr::RM_JUNCTOR | Resource_Mgr::RM_TONE_CHANNEL, Resource_Mgr::RP_NORMAL)) {
+			linfo->junctor_seized = Xps_logical.seize(&linfo->jinfo, Conn.claim_resource(linfo, Resource_Mgr::RT_JUNCTOR), linfo);
+			linfo->tone_plant_descriptor = Tone_plant.channel_seize(Conn.claim_resource(linfo, Resource_Mgr::RT_TONE_CHANNEL), linfo);
+			if(!linfo->junctor_seized || (linfo->tone_plant_descriptor < 0)) {
+				Conn.abandon_resources(linfo);
+				break;
+			}
+			Conn.prepare(linfo, Connector::ET_LINE, line);
 			linfo->state = LS_ORIG_DISCONNECT_C;
 		}
 		break;
 
 	case LS_ORIG_DISCONNECT_C: /* Called perspective */
-		/* Connect phone to junctor */
-		Xps_logical.connect_phone_orig(&linfo->jinfo, this->_line_to_service);
-		/* Connect tone plant to junctor */
+		/* Connect phone and tone plant to junctor */
+		Xps_logical.begin();
+		Xps_logical.connect_phone_orig(&linfo->jinfo, line);
 		Xps_logical.connect_tone_plant_output(&linfo->jinfo, linfo->tone_plant_descriptor);
+		Xps_logical.commit();
 		/* Send Congestion */
 		Conn.send_congestion(linfo);
 		/* Start the dial timer for congestion time out*/
@@ -783,7 +895,7 @@ void Sub_Line::poll(void) {
 
 	case LS_ORIG_DISCONNECT_E: /*Called perspective */
 		/* Tell the line card we're done with this call */
-		Card_comm.send_command(Card_Comm::RT_LINE, this->_line_to_service, REG_END_CALL);
+		Card_comm.send_command(Card_Comm::RT_LINE, line, REG_END_CALL, 0, Card_Comm::CP_URGENT);
 		linfo->state = LS_RESET;
 		break;
 
@@ -808,10 +920,14 @@ void Sub_Line::poll(void) {
 	case LS_RESET:
 		/* Stop dial timer if it was running */
 		osTimerStop(linfo->dial_timer);
-		/* Release any resources first */
+		/* Release any trunk seized for cut-through dialing if the caller hung up */
+		Conn.cancel_cut_through(linfo);
+		/* Leave the resource queue, then release any resources */
+		Conn.release_resources(linfo);
 		Conn.release_tone_generator(linfo);
 		Conn.release_mf_receiver(linfo);
 		Conn.release_dtmf_receiver(linfo);
+		Conn.release_config(linfo);
 
 		/* Then release the junctor if we seized it initially */
 		if(linfo->junctor_seized) {
@@ -829,13 +945,6 @@ void Sub_Line::poll(void) {
 
 	}
 
-	this->_line_to_service++;
-	if(this->_line_to_service >= (MAX_DUAL_LINE_CARDS * 2)) {
-		this->_line_to_service = 0;
-	}
-
-
-	osMutexRelease(this->_lock); /* Release the lock */
 }
 
 /*
@@ -1343,37 +1343,19 @@ void Tone_Plant::stop(int32_t descriptor) {
  *
  * If the requested channel is -1, the next available channel will be returned,
  * else the requested channel will be tested to see if it is available.
+ * A channel reserved through the resource manager is only available to its owner.
  *
  * If no channel is available, return -1.
  */
 
-int32_t Tone_Plant::channel_seize(int32_t requested_channel) {
-	int32_t descriptor = (int32_t) NUM_TONE_OUTPUTS;;
-	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+int32_t Tone_Plant::channel_seize(int32_t requested_channel, void *owner) {
+	int32_t descriptor = -1;
 
-	if(requested_channel == -1) {
-		for(descriptor = 0; descriptor < (int32_t) NUM_TONE_OUTPUTS; descriptor++){
-			if((this->_busy_bits & (1 << descriptor)) == 0) {
-				this->_busy_bits |= (1 << descriptor);
-				break;
-			}
-		}
-	}
-	else { /* Test and seize a specific descriptor */
-		if((requested_channel >= 0) && (requested_channel < (int32_t) NUM_TONE_OUTPUTS) &&
-				((this->_busy_bits & (1 << requested_channel)) == 0)) {
-			this->_busy_bits |= (1 << requested_channel);
-			descriptor = requested_channel; /* Grant channel */
-		}
-		else {
-			descriptor = (int32_t) NUM_TONE_OUTPUTS; /* Not available */
-		}
+	if((requested_channel >= -1) && (requested_channel < (int32_t) NUM_TONE_OUTPUTS)) {
+		/* The channel busy bits are kept by the resource manager */
+		descriptor = Resource_mgr.allocate(Resource_Mgr::RT_TONE_CHANNEL, requested_channel, owner);
 	}
 
-	osMutexRelease(this->_lock); /* Release the lock */
-	if(descriptor >= (int32_t) NUM_TONE_OUTPUTS) {
-		descriptor = -1;
-	}
 	/* LOG_DEBUG(TAG, "channel seize descriptor: %u", descriptor); */
 	return descriptor;
 }
@@ -1399,11 +1381,11 @@ void Tone_Plant::channel_release(int32_t descriptor) {
 	channelInfo *ch_info = &this->_channel_info[descriptor];
 	ch_info->state = AS_IDLE;
 
-	/* Un-busy the channel */
-	this->_busy_bits &= ~(1 << descriptor);
-
 	osMutexRelease(this->_lock); /* Release the lock */
 
+	/* Un-busy the channel. This may hand it straight to a waiter. */
+	Resource_mgr.release(Resource_Mgr::RT_TONE_CHANNEL, descriptor);
+
 }
 
 /*
@@ -1417,6 +1399,9 @@ void Tone_Plant::channel_release(int32_t descriptor) {
  * If the allocation is successful a pointer to the buffer
  * will be returned.
  *
+ * The buffer isn't visible to get_audio_buffer() and audio_buffer_exists()
+ * until set_audio_buffer_ready() is called after the audio data has been loaded.
+ *
  * NULL will be returned on allocation failure.
  */
 
@@ -1438,6 +1423,7 @@ uint8_t *Tone_Plant::allocate_audio_buffer(uint32_t size, const char *name) {
 	/* Set buffer start and size */
 	pabe->buffer_start = this->_audio_buffer_info.next_buffer;
 	pabe->buffer_size = size;
+	pabe->ready = false;
 
 	/* Housekeeping */
 
@@ -1466,13 +1452,13 @@ uint8_t  *Tone_Plant::get_audio_buffer(const char *name, uint32_t *size) {
 
 	/* Attempt to locate buffer by name */
 	for(index = 0; index < AUDIO_BUFFERS_MAX; index++) {
-		if(!strcmp(name, this->_audio_buffer_entries[index].name)) {
+		if((this->_audio_buffer_entries[index].ready) && (!strcmp(name, this->_audio_buffer_entries[index].name))) {
 			break;
 		}
 	}
 
 	if(index >= AUDIO_BUFFERS_MAX) {
-		/* Name not found */
+		/* Name not found, or not loaded yet */
 		return NULL;
 	}
 
@@ -1496,13 +1482,13 @@ bool Tone_Plant::audio_buffer_exists(const char *name) {
 	/* Attempt to locate buffer by name */
 	uint32_t index;
 	for(index = 0; index < AUDIO_BUFFERS_MAX; index++) {
-		if(!strcmp(name, this->_audio_buffer_entries[index].name)) {
+		if((this->_audio_buffer_entries[index].ready) && (!strcmp(name, this->_audio_buffer_entries[index].name))) {
 			break;
 		}
 	}
 
 	if(index >= AUDIO_BUFFERS_MAX) {
-		/* Name not found */
+		/* Name not found, or not loaded yet */
 		return false;
 	}
 
@@ -1510,6 +1496,24 @@ bool Tone_Plant::audio_buffer_exists(const char *name) {
 
 }
 
+/*
+ * Mark an audio buffer as loaded, making it visible to callers
+ */
+
+void Tone_Plant::set_audio_buffer_ready(const char *name) {
+	if(!name) {
+		POST_ERROR(Err_Handler::EH_IVD);
+	}
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+	for(uint32_t index = 0; index < this->_audio_buffer_info.num_buffers_allocated; index++) {
+		if(!strcmp(name, this->_audio_buffer_entries[index].name)) {
+			this->_audio_buffer_entries[index].ready = true;
+			break;
+		}
+	}
+	osMutexRelease(this->_lock); /* Release the lock */
+}
+
 
 
 
@@ -5,6 +5,7 @@
 #include "i2c_engine.h"
 #include "console.h"
 #include "logging.h"
+#include "err_handler.h"
 #include "tone_plant.h"
 #include "drv_dtmf.h"
 #include "drv_xps.h"
@@ -17,6 +18,7 @@
 #include "hw_pres.h"
 #include "config_rw.h"
 #include "connector.h"
+#include "resource_mgr.h"
 
 
 Sub_Line::Sub_Line Sub_line;
@@ -30,6 +32,63 @@ void dummy_callback(uint32_t channel_number) {
 }
 
 
+/*
+ * Boot stages. The start and end times are recorded in milliseconds since the kernel started.
+ */
+
+enum {BS_RESOURCES=0, BS_FILE_SYSTEM, BS_CONFIG, BS_PROBE, BS_LINES_TRUNKS, BS_CALL_CONFIG, BS_CALL_PROCESSING, NUM_BOOT_STAGES};
+
+typedef struct Boot_Stage {
+	const char *name;
+	uint32_t start;
+	uint32_t end;
+} Boot_Stage;
+
+static Boot_Stage boot_stages[NUM_BOOT_STAGES] = {
+		{"resources", 0, 0},
+		{"file system", 0, 0},
+		{"config", 0, 0},
+		{"hardware probe", 0, 0},
+		{"lines and trunks", 0, 0},
+		{"call config", 0, 0},
+		{"call processing", 0, 0}
+};
+
+static void _boot_stage_start(uint32_t stage) {
+	boot_stages[stage].start = osKernelGetTickCount();
+}
+
+static void _boot_stage_end(uint32_t stage) {
+	boot_stages[stage].end = osKernelGetTickCount();
+}
+
+/* Boot event flags */
+enum {BEF_PROBE_DONE = 1};
+
+static const osEventFlagsAttr_t boot_flags_attr = {
+	"BootEventFlags",
+	0,
+	NULL,
+	0
+};
+
+static osEventFlagsId_t boot_flags;
+
+/*
+ * Hardware probe boot task.
+ *
+ * Runs concurrently with file system and configuration loading, then exits.
+ */
+
+static void _boot_probe_task(void *args) {
+	_boot_stage_start(BS_PROBE);
+	HW_pres.probe();
+	_boot_stage_end(BS_PROBE);
+	osEventFlagsSet(boot_flags, BEF_PROBE_DONE);
+	osThreadExit();
+}
+
+
 /*
  * Called once before RTOS initialization
  */
@@ -42,36 +101,87 @@ void Top_setup(void) {
 }
 
 
+/*
+ * Called once from the default task to initialize the system
+ *
+ * Boot dependencies:
+ *
+ * resources -> hardware probe ---------------------------------> call processing
+ * resources -> file system -> config -> call config -----------/
+ * resources -> lines and trunks ------------------------------/
+ *
+ * The hardware probe runs in its own task, in parallel with the file system and configuration stages.
+ */
+
 void Top_init(void) {
 
-	osDelay(1000);
+	static const osThreadAttr_t boot_probe_attr = {
+			"BootProbeThread",
+			osThreadDetached,
+			NULL,
+			0,
+			NULL,
+			1024,
+			osPriorityNormal,
+			0,
+			0
+	};
 
 	/*
 	 * Resources
 	 */
 
+	_boot_stage_start(BS_RESOURCES);
 	Utility.init();
 	Logger.init();
 	I2c.init();
+	Resource_mgr.init();
 	MF_decoder.init();
 	Dtmf_receivers.init();
 	Tone_plant.init();
 	Xps_driver.init();
 	Xps_logical.init();
 	Card_comm.init();
+	_boot_stage_end(BS_RESOURCES);
 
 	/* After resources.
 	 * Depends on resources being initialized
 	 */
 
+	/* Start the hardware probe. It only depends on the I2C engine */
+	boot_flags = osEventFlagsNew(&boot_flags_attr);
+	if(!boot_flags) {
+		POST_ERROR(Err_Handler::EH_EFC);
+	}
+	if(osThreadNew(_boot_probe_task, NULL, &boot_probe_attr) == NULL) {
+		POST_ERROR(Err_Handler::EH_TSF);
+	}
+
+	_boot_stage_start(BS_FILE_SYSTEM);
 	File_io.init();
+	_boot_stage_end(BS_FILE_SYSTEM);
+
+	_boot_stage_start(BS_CONFIG);
 	Config_rw.init();
-	HW_pres.probe();
+	_boot_stage_end(BS_CONFIG);
+
+	_boot_stage_start(BS_LINES_TRUNKS);
 	Trunks.init();
 	Sub_line.init();
 	Conn.init();
+	_boot_stage_end(BS_LINES_TRUNKS);
 
+	/*
+	 * Call configuration methods here
+	 */
+	_boot_stage_start(BS_CALL_CONFIG);
+	Xps_logical.config();
+	Sub_line.config();
+	Conn.config();
+	_boot_stage_end(BS_CALL_CONFIG);
 
+	/* The probe powers down the lines, so it must be finished before they are powered up again */
+	osEventFlagsWait(boot_flags, BEF_PROBE_DONE, osFlagsWaitAny, osWaitForever);
 
 	/* Test Code Begin */
 	Card_comm.send_command(Card_Comm::RT_LINE, 0, Sub_Line::REG_POWER_CTRL, true);
@@ -85,23 +195,26 @@ void Top_init(void) {
 
 	/* Test Code End */
 
-	/*
-	 * Call configuration methods here
-	 */
-	Sub_line.config();
-	Conn.config();
-
 
 	/*
 	 * Start processing calls
 	 */
 
+	_boot_stage_start(BS_CALL_PROCESSING);
 	Event_handler.init();
+	_boot_stage_end(BS_CALL_PROCESSING);
 
+	/* Load the audio samples in the background. Precise tones are used until they are loaded. */
+	Config_rw.start_prefetch();
 
+	/* Print the boot stage timing */
+	for(uint32_t stage = 0; stage < NUM_BOOT_STAGES; stage++) {
+		Boot_Stage *bs = &boot_stages[stage];
+		LOG_INFO(TAG, "Boot stage %-16s started at %5u ms, took %5u ms", bs->name, (unsigned) bs->start,
+				(unsigned) (bs->end - bs->start));
+	}
 
-
-	LOG_INFO(TAG, "Initialization completed");
+	LOG_INFO(TAG, "Initialization completed in %u ms", (unsigned) osKernelGetTickCount());
 	/* Turn on green LED to signify Initialization complete */
 	HAL_GPIO_WritePin(GREEN_LED_GPIO_Port, GREEN_LED_Pin, GPIO_PIN_SET);
 }
@@ -195,6 +308,10 @@ void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c) {
 	I2c.handler(hi2c, I2C_Engine::MSG_I2C_RX);
 }
 
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+	I2c.handler(hi2c, I2C_Engine::MSG_I2C_RX);
+}
+
 void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
 	I2c.handler(hi2c, I2C_Engine::MSG_I2C_ERR);
 
@@ -10,6 +10,7 @@
 #include "connector.h"
 #include "hw_pres.h"
 #include "trunk.h"
+#include "event.h"
 
 Trunk::Trunk Trunks;
 static const char *TAG = "trunk";
@@ -62,6 +63,7 @@ void Trunk::_mf_receiver_callback(void *parameter, uint8_t error_code, uint8_t d
 			tinfo->state = TS_SEND_CONGESTION;
 		}
 	}
+	this->_post_event(tinfo->phys_line_trunk_number);
 
 	osMutexRelease(this->_lock); /* Release the lock */
 
@@ -87,6 +89,7 @@ void Trunk::_mf_sending_complete(uint32_t descriptor, void *data) {
 
 	if(tinfo->state == TS_OUTGOING_SEND_ADDR_INFO_B) {
 		tinfo->state = TS_OUTGOING_SEND_ADDR_INFO_C;
+		this->_post_event(tinfo->phys_line_trunk_number);
 	}
 
 	osMutexRelease(this->_lock); /* Release the lock */
@@ -130,8 +133,6 @@ void Trunk::event_handler(uint32_t event_type, uint32_t resource) {
 		case EV_CALL_DROPPED:
 			switch(tinfo->state) {
 			case TS_SEIZE_JUNCTOR:
-			case TS_SEIZE_TG:
-			case TS_SEIZE_MFR:
 			case TS_WAIT_ADDR_INFO:
 			case TS_HAVE_ADDR_INFO:
 			case TS_SEND_BUSY:
@@ -207,6 +208,7 @@ void Trunk::event_handler(uint32_t event_type, uint32_t resource) {
 
 
 		}
+		this->_post_event(resource);
 	}
 	osMutexRelease(this->_lock); /* Release the lock */
 }
@@ -326,6 +328,7 @@ uint32_t Trunk::peer_message_handler(Connector::Conn_Info *conn_info, uint32_t p
 	}
 
 	}
+	this->_post_event(phys_line_trunk_number);
 
 	return res;
 }
@@ -357,6 +360,8 @@ void Trunk::init(void) {
 		tinfo->phys_line_trunk_number = index;
 		tinfo->equip_type = Connector::ET_TRUNK;
 		tinfo->tone_plant_descriptor = tinfo->mf_receiver_descriptor = tinfo->dtmf_receiver_descriptor = -1;
+		Conn.init_resources(tinfo);
+		tinfo->cut_through = Connector::CT_NONE;
 
 
 	}
@@ -387,47 +392,113 @@ bool Trunk::_test_pending_state(Connector::Conn_Info *tinfo) {
 
 
 /*
- * Called repeatedly by event task
+ * Post an event for a trunk.
+ *
+ * Marks the trunk as having work to do and wakes the event worker.
+ *
+ * Takes no lock, as it is called from tone plant, MF receiver and resource manager callbacks
+ * which may hold their own locks while poll() holds ours and calls into them.
+ */
+
+void Trunk::_post_event(uint32_t trunk_number) {
+	if(trunk_number >= MAX_TRUNK_CARDS) {
+		POST_ERROR(Err_Handler::EH_ITN);
+	}
+	__atomic_fetch_or(&this->_pending_trunks, (1UL << trunk_number), __ATOMIC_ACQ_REL);
+
+	Event_handler.wake();
+}
+
+/*
+ * Wake a trunk waiting for a resource
+ */
+
+void Trunk::wake(uint32_t trunk_number) {
+	this->_post_event(trunk_number);
+}
+
+
+/*
+ * Called by the event worker.
+ *
+ * Services every trunk which has a pending event, and on a timer tick, every trunk which is not idle.
+ * Each trunk is stepped until its state stops changing.
  */
 
-void Trunk::poll(void) {
+void Trunk::poll(bool tick) {
 
 	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
 
-	Connector::Conn_Info *tinfo = &this->_conn_info[this->_trunk_to_service];
+	for(uint32_t pass = 0; pass < MAX_SERVICE_PASSES; pass++) {
+		uint32_t pending = __atomic_exchange_n(&this->_pending_trunks, 0, __ATOMIC_ACQ_REL);
+
+		for(uint8_t trunk = 0; trunk < MAX_TRUNK_CARDS; trunk++) {
+			Connector::Conn_Info *tinfo = &this->_conn_info[trunk];
+
+			if(!(pending & (1 << trunk)) && !(tick && (tinfo->state != TS_IDLE) && (tinfo->state != TS_OFFLINE))) {
+				continue;
+			}
+
+			for(uint32_t step = 0; step < MAX_SERVICE_STEPS; step++) {
+				uint32_t prev_state = tinfo->state;
+				this->_service(trunk);
+				if(tinfo->state == prev_state) {
+					break;
+				}
+			}
+		}
+		/* Only run again if servicing a trunk posted an event for another trunk */
+		if(!__atomic_load_n(&this->_pending_trunks, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+		tick = false;
+	}
+
+	osMutexRelease(this->_lock); /* Release the lock */
+}
+
+
+/*
+ * Run the state machine for one trunk
+ */
+
+void Trunk::_service(uint8_t trunk) {
+
+	Connector::Conn_Info *tinfo = &this->_conn_info[trunk];
 
 	switch(tinfo->state) {
 	case TS_IDLE:
 		/* Wait for Request IR  or seize event */
 		break;
 
-	case TS_SEIZE_JUNCTOR:
-		if(Xps_logical.seize(&tinfo->jinfo)) {
-			tinfo->junctor_seized = true;
-			Conn.prepare(tinfo, Connector::ET_TRUNK, this->_trunk_to_service);
-			tinfo->state = TS_SEIZE_TG;
-		}
-		break;
+	/*
+	 * The junctor, tone generator and MF receiver are reserved together through the resource manager.
+	 * If they aren't all free, nothing is held, and the trunk is queued and woken when they are reserved for it.
+	 * Incoming trunk calls are queued ahead of line originations, as the far end is already waiting for a wink.
+	 * The whole set is then claimed at once. If a claim fails anyway, everything is given up and reserved again.
+	 */
 
-	case TS_SEIZE_TG:
-		if((tinfo->tone_plant_descriptor = Tone_plant.channel_seize()) >= 0) {
+	case TS_SEIZE_JUNCTOR:
+		if(Conn.reserve_resources(tinfo, Resource_Mgr::RM_JUNCTOR | Resource_Mgr::RM_TONE_CHANNEL | Resource_Mgr::RM_MF_RECEIVER,
+				Resource_Mgr::RP_HIGH)) {
+			tinfo->junctor_seized = Xps_logical.seize(&tinfo->jinfo, Conn.claim_resource(tinfo, Resource_Mgr::RT_JUNCTOR), tinfo);
+			tinfo->tone_plant_descriptor = Tone_plant.channel_seize(Conn.claim_resource(tinfo, Resource_Mgr::RT_TONE_CHANNEL), tinfo);
+			tinfo->mf_receiver_descriptor = MF_decoder.seize(__mf_receiver_callback, tinfo,
+					Conn.claim_resource(tinfo, Resource_Mgr::RT_MF_RECEIVER), false, tinfo);
+			if(!tinfo->junctor_seized || (tinfo->tone_plant_descriptor < 0) || (tinfo->mf_receiver_descriptor < 0)) {
+				Conn.abandon_resources(tinfo);
+				break;
+			}
+			Conn.prepare(tinfo, Connector::ET_TRUNK, trunk);
+			/* Connect the tone generator, trunk RX and TX and the MF receiver to the junctor in one batch */
+			Xps_logical.begin();
 			Xps_logical.connect_tone_plant_output(&tinfo->jinfo, tinfo->tone_plant_descriptor);
-			tinfo->state = TS_SEIZE_MFR;
-		}
-		break;
-
-
-	case TS_SEIZE_MFR: /* Seize MF receiver */
-		if((tinfo->mf_receiver_descriptor = MF_decoder.seize(__mf_receiver_callback, tinfo )) > -1) {
-			/* Connect trunk RX and TX to assigned junctor */
-			Xps_logical.connect_trunk_orig(&tinfo->jinfo, this->_trunk_to_service);
-			/* Make audio connection to seized MF receiver */
+			Xps_logical.connect_trunk_orig(&tinfo->jinfo, trunk);
 			Xps_logical.connect_mf_receiver(&tinfo->jinfo, tinfo->mf_receiver_descriptor);
+			Xps_logical.commit();
 			/* Tell trunk card to send a wink */
-			Card_comm.send_command(Card_Comm::RT_TRUNK, this->_trunk_to_service, REG_SEND_WINK);
-			Conn.prepare(tinfo, Connector::ET_TRUNK, tinfo->phys_line_trunk_number);
+			Card_comm.send_command(Card_Comm::RT_TRUNK, trunk, REG_SEND_WINK, 0, Card_Comm::CP_URGENT);
 			tinfo->state = TS_WAIT_ADDR_INFO;
-
 		}
 		break;
 
@@ -453,6 +524,7 @@ void Trunk::poll(void) {
 			case Connector::ROUTE_DEST_TRUNK_BUSY:
 				/* If destination is a trunk, then we need to try to select another trunk in the group */
 				if(tinfo->route_info.dest_equip_type == Connector::ET_TRUNK) {
+					LOG_DEBUG(TAG, "Trunk not available from Conn.resolve(), advancing");
 					tinfo->state = TS_TANDEM_ADVANCE;
 
 				}
@@ -529,12 +601,13 @@ void Trunk::poll(void) {
 		break;
 
 	case TS_INCOMING_CONNECT_AUDIO:
-		/* Disconnect and release the tone generator */
+		/* Disconnect and release the tone generator, and connect the called party audio to the junctor */
+		Xps_logical.begin();
 		Conn.release_tone_generator(tinfo);
-		/* Connect the called party audio to the junctor */
 		Conn.connect_called_party_audio(tinfo);
+		Xps_logical.commit();
 		/* Tell originator the called party answered */
-		Card_comm.send_command(Card_Comm::RT_TRUNK, this->_trunk_to_service, REG_INCOMING_CONNECTED);
+		Card_comm.send_command(Card_Comm::RT_TRUNK, trunk, REG_INCOMING_CONNECTED, 0, Card_Comm::CP_URGENT);
 		tinfo->state = TS_INCOMING_ANSWERED;
 		break;
 
@@ -544,7 +617,7 @@ void Trunk::poll(void) {
 	case TS_INCOMING_TEARDOWN:
 		if(tinfo->called_party_hangup) {
 			/* LOG_DEBUG(TAG, "Sending drop call to trunk card"); */
-			Card_comm.send_command(Card_Comm::RT_TRUNK, this->_trunk_to_service, REG_DROP_CALL);
+			Card_comm.send_command(Card_Comm::RT_TRUNK, trunk, REG_DROP_CALL, 0, Card_Comm::CP_URGENT);
 		}
 		else {
 			/* LOG_DEBUG(TAG, "Releasing called party"); */
@@ -573,8 +646,10 @@ void Trunk::poll(void) {
 		LOG_DEBUG(TAG, "Tandem call outgoing address info: %s", tinfo->trunk_outgoing_address);
 
 		/* Clear everything off of the junctor and let the outgoing trunk do what it needs to do */
+		Xps_logical.begin();
 		Conn.release_tone_generator(tinfo);
 		Conn.disconnect_caller_party_audio(tinfo);
+		Xps_logical.commit();
 
 		/* Tell the outgoing trunk the address has been formatted and is ready to send */
 		Conn.send_message_to_dest(tinfo, Connector::PM_TRUNK_ADDR_INFO_READY);
@@ -602,7 +677,7 @@ void Trunk::poll(void) {
 	case TS_TANDEM_SUPV:
 		/* Send answer supervision back to caller's switch */
 		LOG_DEBUG(TAG, "Tandem answer supervision seen, relaying to originator");
-		Card_comm.send_command(Card_Comm::RT_TRUNK, this->_trunk_to_service, REG_INCOMING_CONNECTED);
+		Card_comm.send_command(Card_Comm::RT_TRUNK, trunk, REG_INCOMING_CONNECTED, 0, Card_Comm::CP_URGENT);
 		tinfo->state = TS_TANDEM_IN_CALL;
 		break;
 
@@ -615,16 +690,12 @@ void Trunk::poll(void) {
 		uint32_t res = Conn.resolve_try_next_trunk(tinfo);
 		switch(res) {
 		case Connector::ROUTE_DEST_TRUNK_BUSY:
-			LOG_DEBUG(TAG, "Trunk busy after trunk advance");
+			/* Logged on entry to the state, not on every retry */
 			break; /* This trunk is busy, try again later */
 
 		case Connector::ROUTE_NO_MORE_TRUNKS:
 			/* No more outgoing trunks to try */
 			LOG_DEBUG(TAG, "No more trunks after trunk advance");
-			/* If the originating trunk tone generator was disconnected, reconnect it here */
-			if(tinfo->tone_plant_descriptor == -1) {
-				Conn.seize_and_connect_tone_generator(tinfo);
-			}
 			tinfo->state = TS_TANDEM_SEND_CONGESTION;
 			break;
 
@@ -644,7 +715,10 @@ void Trunk::poll(void) {
 
 
 	case TS_TANDEM_SEND_CONGESTION:
-		/* Seize a tone generator */
+		/* If the originating trunk tone generator was disconnected, reconnect it here. Wait if none is free yet. */
+		if((tinfo->tone_plant_descriptor == -1) && !Conn.seize_and_connect_tone_generator(tinfo)) {
+			break;
+		}
 		Conn.send_congestion(tinfo);
 		/* Wait for caller to disconnect */
 		tinfo->state = TS_TANDEM_CONGESTION;
@@ -668,7 +742,7 @@ void Trunk::poll(void) {
 	case TS_TANDEM_CALLED_DISCONNECTED:
 		LOG_DEBUG(TAG, "Tandem called party disconnected");
 		/* Called party disconnected */
-		Card_comm.send_command(Card_Comm::RT_TRUNK, this->_trunk_to_service, REG_DROP_CALL);
+		Card_comm.send_command(Card_Comm::RT_TRUNK, trunk, REG_DROP_CALL, 0, Card_Comm::CP_URGENT);
 		tinfo->state = TS_RESET;
 		break;
 
@@ -685,7 +759,7 @@ void Trunk::poll(void) {
 
 		/* Seize the trunk */
 		LOG_DEBUG(TAG, "Send seize trunk command to card, wait for wink or busy");
-		Card_comm.send_command(Card_Comm::RT_TRUNK, this->_trunk_to_service, REG_SEIZE_TRUNK);
+		Card_comm.send_command(Card_Comm::RT_TRUNK, trunk, REG_SEIZE_TRUNK, 0, Card_Comm::CP_URGENT);
 		tinfo->state = TS_WAIT_WINK_OR_BUSY;
 		break;
 
@@ -731,7 +805,8 @@ void Trunk::poll(void) {
 		}
 		/* Seize a tone plant channel */
 		/* Utilize the peer data structure for this */
-		if((tinfo->peer->tone_plant_descriptor = Tone_plant.channel_seize()) != -1) {
+		/* If one has to be waited for, the peer line is woken when it is reserved, and this is retried on the next tick */
+		if((tinfo->peer->tone_plant_descriptor = Conn.seize_tone_generator(tinfo->peer)) != -1) {
 			/* Connect the tone plant to the junctor */
 			Xps_logical.connect_tone_plant_output(&tinfo->peer->jinfo, tinfo->peer->tone_plant_descriptor, false);
 			/* Connect the outgoing trunk to the junctor */
@@ -762,7 +837,7 @@ void Trunk::poll(void) {
 		Conn.release_tone_generator(tinfo->peer);
 
 		/* Send outgoing address complete message to trunk card */
-		Card_comm.send_command(Card_Comm::RT_TRUNK, this->_trunk_to_service, REG_OUTGOING_ADDR_COMPLETE);
+		Card_comm.send_command(Card_Comm::RT_TRUNK, trunk, REG_OUTGOING_ADDR_COMPLETE, 0, Card_Comm::CP_URGENT);
 
 		/* Send message to peer that the caller can now be connected. */
 		Conn.send_peer_message(tinfo, Connector::PM_TRUNK_READY_TO_CONNECT_CALLER);
@@ -806,7 +881,10 @@ void Trunk::poll(void) {
 	case TS_GOT_NO_WINK: {
 		/* Timed out waiting for wink */
 	    /* Disconnect the tone generator, the originator will reconnect it to the correct place if need be */
-		Conn.release_tone_generator(tinfo->peer);
+		/* A caller still dialing under cut-through keeps its tone generator */
+		if(tinfo->peer->cut_through != Connector::CT_SEIZED) {
+			Conn.release_tone_generator(tinfo->peer);
+		}
 		LOG_DEBUG(TAG, "Sending Wink timeout PM");
 		Conn.send_peer_message(tinfo, Connector::PM_TRUNK_NO_WINK);
 		tinfo->state = TS_RELEASE_TRUNK;
@@ -819,7 +897,10 @@ void Trunk::poll(void) {
 	case TS_SEND_TRUNK_BUSY: {
 		/* LOG_DEBUG(TAG, "Sending trunk busy PM"); */
 		/* Disconnect the tone generator, the originator will reconnect it to the correct place if need be */
-		Conn.release_tone_generator(tinfo->peer);
+		/* A caller still dialing under cut-through keeps its tone generator */
+		if(tinfo->peer->cut_through != Connector::CT_SEIZED) {
+			Conn.release_tone_generator(tinfo->peer);
+		}
 		Conn.send_peer_message(tinfo, Connector::PM_TRUNK_BUSY);
 		tinfo->state = TS_RELEASE_TRUNK;
 	}
@@ -827,18 +908,20 @@ void Trunk::poll(void) {
 
 
 	case TS_RELEASE_TRUNK:
-		/* LOG_DEBUG(TAG, "Sending release command to trunk card %u", this->_trunk_to_service); */
-		Card_comm.send_command(Card_Comm::RT_TRUNK, this->_trunk_to_service, REG_DROP_CALL);
+		/* LOG_DEBUG(TAG, "Sending release command to trunk card %u", trunk); */
+		Card_comm.send_command(Card_Comm::RT_TRUNK, trunk, REG_DROP_CALL, 0, Card_Comm::CP_URGENT);
 		tinfo->state = TS_RESET;
 		break;
 
 
 	case TS_RESET:
 		/* Clean up */
-		/* Release any resources first */
+		/* Leave the resource queue, then release any resources */
+		Conn.release_resources(tinfo);
 		Conn.release_tone_generator(tinfo);
 		Conn.release_mf_receiver(tinfo);
 		Conn.release_dtmf_receiver(tinfo);
+		Conn.release_config(tinfo);
 
 		/* Then release the junctor if we seized it initially */
 		if(tinfo->junctor_seized) {
@@ -860,18 +943,6 @@ void Trunk::poll(void) {
 		tinfo->state = TS_RESET;
 		break;
 	}
-
-
-	this->_trunk_to_service++;
-	if(this->_trunk_to_service >= MAX_TRUNK_CARDS) {
-		this->_trunk_to_service = 0;
-	}
-
-
-
-	osMutexRelease(this->_lock); /* Release the lock */
-
-
 }
 
 /*
@@ -928,6 +999,7 @@ bool Trunk::go_online(uint32_t trunk_number) {
 
 	if(tinfo->state == TS_OFFLINE) {
 		tinfo->state = TS_IDLE;
+		this->_post_event(trunk_number);
 	}
 	else {
 		res = false;
@@ -297,27 +297,156 @@ char *Util::strdup_until(const char *str, char stop_char, uint32_t max_len) {
 
 /*
  * Trim all spaces and tabs from string
+ *
+ * The string is modified in place.
  */
 
 char *Util::trim(char *str) {
 
-	char *work_string = this->strdup(str);
 	uint32_t s_index;
 	uint32_t d_index;
-	for(s_index = 0, d_index = 0; work_string[s_index]; s_index++) {
-		if((work_string[s_index] == ' ')||(work_string[s_index] == '\t')) {
+	for(s_index = 0, d_index = 0; str[s_index]; s_index++) {
+		if((str[s_index] == ' ')||(str[s_index] == '\t')) {
 			continue;
 		}
 		else {
-			str[d_index++] = work_string[s_index];
+			str[d_index++] = str[s_index];
 		}
 	}
 	str[d_index] = 0;
-	this->deallocate_long_string(work_string);
 	return str;
 
 }
 
+/*
+ * Split a string into one or more spans without copying it
+ *
+ * Arguments:
+ *
+ * 1. Str is the composite string to split. It is not modified.
+ * 2. Spans is an array of spans which needs to be passed in.
+ * 3. Max spans is the size of the span array.
+ * 4. Set the split character to the character used to delimit the substrings.
+ *
+ * If there are more substrings than max spans, the last span holds the rest of the string.
+ *
+ * Returns the number of spans found.
+ */
+
+uint32_t Util::split(const char *str, Str_Span_Type spans[], uint32_t max_spans, char split_char) {
+
+	if((!str) || (!spans)) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	if(max_spans < 1) {
+		POST_ERROR(Err_Handler::EH_INVP);
+	}
+
+	uint32_t found = 0;
+	spans[found].str = str;
+	for(; *str; str++) {
+		if((*str == split_char) && (found < max_spans - 1)) {
+			/* Found a delimiter, end the current span and start the next one */
+			spans[found].len = str - spans[found].str;
+			found++;
+			spans[found].str = str + 1;
+		}
+	}
+	/* Last span ends at the end of the string */
+	spans[found].len = str - spans[found].str;
+	found++;
+
+	return found;
+}
+
+/*
+ * Copy a span into a zero terminated destination string
+ *
+ * Returns false if the span had to be truncated to fit.
+ */
+
+bool Util::span_copy(char *dest, const Str_Span_Type &span, uint32_t dest_size) {
+
+	if((!dest) || (!dest_size)) {
+		POST_ERROR(Err_Handler::EH_INVP);
+	}
+
+	uint32_t len = (span.len < dest_size - 1) ? span.len : dest_size - 1;
+	for(uint32_t index = 0; index < len; index++) {
+		dest[index] = span.str[index];
+	}
+	dest[len] = 0;
+	return (len == span.len);
+}
+
+/*
+ * Return true if a span matches a zero terminated string
+ */
+
+bool Util::span_equals(const Str_Span_Type &span, const char *str) {
+	uint32_t index;
+	for(index = 0; index < span.len; index++) {
+		if(span.str[index] != str[index]) {
+			return false;
+		}
+	}
+	return (str[index] == 0);
+}
+
+/*
+ * Attempt to match a span against a table of strings.
+ * Return -1 if no match found, else return the index of
+ * the match string in the table if there was a match.
+ */
+
+int32_t Util::span_keyword_match(const Str_Span_Type &span, const char *match_table[]) {
+	for(int32_t index = 0; match_table[index]; index++) {
+		if(this->span_equals(span, match_table[index])) {
+			return index;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Convert a span of decimal digits to an unsigned number
+ *
+ * Returns false if the span is empty, contains anything other than digits, or overflows.
+ */
+
+bool Util::span_to_unsigned(const Str_Span_Type &span, unsigned &value) {
+	if(!span.len) {
+		return false;
+	}
+	uint32_t result = 0;
+	for(uint32_t index = 0; index < span.len; index++) {
+		char c = span.str[index];
+		if((c < '0') || (c > '9')) {
+			return false;
+		}
+		uint32_t digit = (uint32_t) (c - '0');
+		if(result > (0xFFFFFFFFUL - digit) / 10) {
+			return false; /* Overflow */
+		}
+		result = (result * 10) + digit;
+	}
+	value = (unsigned) result;
+	return true;
+}
+
+/*
+ * Convert a zero terminated string of decimal digits to an unsigned number
+ */
+
+bool Util::parse_unsigned(const char *str, unsigned &value) {
+	if(!str) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+	Str_Span_Type span = {str, (uint32_t) strlen(str)};
+	return this->span_to_unsigned(span, value);
+}
+
 /*
  * Split a string into one or more substrings
  *
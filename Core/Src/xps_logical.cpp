@@ -5,11 +5,30 @@
 #include "mf_receiver.h"
 #include "drv_dtmf.h"
 #include "xps_logical.h"
+#include "config_rw.h"
+#include "resource_mgr.h"
+#include <string.h>
 
 static const char *TAG = "xpslogical";
 
 namespace XPS_Logical {
 
+/* Number of columns and the spacing between them for each column group */
+typedef struct Column_Usage {
+	uint8_t count;
+	uint8_t stride;
+	const char *keyword;
+} Column_Usage;
+
+static const Column_Usage column_usage[NUM_FABRIC_COLUMN_GROUPS] = {
+		{MAX_SUB_LINES * 2, 1, "lines"},
+		{MAX_TRUNKS * 2, 1, "trunks"},
+		{Tone_Plant::NUM_TONE_OUTPUTS, 2, "tone_plant"},
+		{Dtmf::NUM_DTMF_RECEIVERS, 2, "dtmf_receivers"},
+		{MF_Decoder::NUM_MF_RECEIVERS, 2, "mf_receivers"}
+};
+
+
 
 /*
  * Validate a descriptor passed in by the caller
@@ -22,6 +41,21 @@ bool XPS_Logical::_validate_descriptor(uint32_t descriptor) {
 	return true;
 }
 
+/*
+ * Return the x location of a column in a column group
+ */
+
+uint8_t XPS_Logical::_get_column_x(uint32_t group, uint32_t index) {
+	if((group >= NUM_FABRIC_COLUMN_GROUPS) || (index >= column_usage[group].count)) {
+		POST_ERROR(Err_Handler::EH_IVXY);
+	}
+	uint32_t x = this->_geometry.column_start[group] + (index * column_usage[group].stride);
+	if(x >= this->get_num_x()) {
+		POST_ERROR(Err_Handler::EH_IVXY);
+	}
+	return (uint8_t) x;
+}
+
 /*
  * Return the x location of the mf receiver for the given descriptor
  */
@@ -30,11 +64,7 @@ uint8_t XPS_Logical::get_mf_receiver_x(int32_t mf_descriptor) {
 	if((mf_descriptor < 0) || (mf_descriptor >= MF_Decoder::NUM_MF_RECEIVERS)) {
 		POST_ERROR(Err_Handler::EH_IVD);
 	}
-	uint8_t x = mf_descriptor * 2;
-
-	x += MF_RECEIVER_COLUMN_START;
-
-	return x;
+	return this->_get_column_x(FC_MF_RECEIVERS, mf_descriptor);
 }
 
 
@@ -46,11 +76,7 @@ uint8_t XPS_Logical::get_dtmf_receiver_x(int32_t dtmf_descriptor) {
 	if((dtmf_descriptor < 0) || (dtmf_descriptor >= Dtmf::NUM_DTMF_RECEIVERS)) {
 		POST_ERROR(Err_Handler::EH_IVD);
 	}
-	uint8_t x = dtmf_descriptor * 2;
-
-	x += DTMF_RECEIVER_COLUMN_START;
-
-	return x;
+	return this->_get_column_x(FC_DTMF_RECEIVERS, dtmf_descriptor);
 }
 
 /*
@@ -58,14 +84,10 @@ uint8_t XPS_Logical::get_dtmf_receiver_x(int32_t dtmf_descriptor) {
  */
 
 uint8_t XPS_Logical::get_tone_plant_x(int32_t tone_plant_descriptor) {
-	if((tone_plant_descriptor < 0) || (tone_plant_descriptor >= Dtmf::NUM_DTMF_RECEIVERS)) {
+	if((tone_plant_descriptor < 0) || (tone_plant_descriptor >= (int32_t) Tone_Plant::NUM_TONE_OUTPUTS)) {
 		POST_ERROR(Err_Handler::EH_IVD);
 	}
-	uint8_t x = tone_plant_descriptor * 2;
-
-	x += TONE_PLANT_COLUMN_START;
-
-	return x;
+	return this->_get_column_x(FC_TONE_PLANT, tone_plant_descriptor);
 }
 
 /*
@@ -76,7 +98,7 @@ uint8_t XPS_Logical::get_sub_line_x(uint8_t line_number) {
 	if(line_number >= MAX_SUB_LINES) {
 		POST_ERROR(Err_Handler::EH_IPLN);
 	}
-	return (line_number * 2) + LINE_COLUMN_START;
+	return this->_get_column_x(FC_LINES, line_number * 2);
 }
 
 /*
@@ -87,7 +109,7 @@ uint8_t XPS_Logical::get_trunk_x(uint8_t trunk_number) {
 	if(trunk_number >= MAX_TRUNKS) {
 		POST_ERROR(Err_Handler::EH_ITN);
 	}
-	return (trunk_number * 2) + TRUNK_COLUMN_START;
+	return this->_get_column_x(FC_TRUNKS, trunk_number * 2);
 }
 
 /*
@@ -95,7 +117,7 @@ uint8_t XPS_Logical::get_trunk_x(uint8_t trunk_number) {
  */
 
 uint8_t XPS_Logical::get_path_y(uint8_t junctor_number, bool orig_term) {
-	if(junctor_number > MAX_JUNCTORS) {
+	if(junctor_number >= MAX_JUNCTORS) {
 		POST_ERROR(Err_Handler::EH_IJN);
 	}
 
@@ -119,7 +141,7 @@ void XPS_Logical::_logical_to_physical(Phys_Switch *s, uint32_t x, uint32_t y) {
 
 	}
 
-	if((x > LOGICAL_NUM_X) || (y > LOGICAL_NUM_Y)) {
+	if((x >= this->get_num_x()) || (y >= LOGICAL_NUM_Y)) {
 		POST_ERROR(Err_Handler::EH_IVXY);
 	}
 
@@ -130,26 +152,84 @@ void XPS_Logical::_logical_to_physical(Phys_Switch *s, uint32_t x, uint32_t y) {
 
 
 /*
- * Close a crosspoint switch
+ * Send the switches in the desired state matrix which differ from the physical state
+ * and should end up in the passed in state to the driver.
+ *
+ * Returns the number of switches changed.
  */
 
-void XPS_Logical::close_switch(uint32_t x, uint32_t y) {
-	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
-	uint16_t byte_addr = (x >> 3)+(y << 2);
-	uint8_t bit_location = x & 7;
-	uint8_t state_bits = this->_matrix_state[byte_addr];
-	Phys_Switch s;
+uint32_t XPS_Logical::_apply_changes(bool state) {
+	Xps::Xps_Op ops[MAX_BATCH_OPS];
+	uint32_t num_ops = 0;
+	uint32_t changed = 0;
+
+	for(uint32_t byte_addr = 0; byte_addr < sizeof(this->_matrix_state); byte_addr++) {
+		uint8_t diff = this->_desired_state[byte_addr] ^ this->_matrix_state[byte_addr];
+		/* Only the switches which need to go to the requested state */
+		diff &= (state) ? this->_desired_state[byte_addr] : this->_matrix_state[byte_addr];
+		for(uint8_t bit_location = 0; diff; bit_location++, diff >>= 1) {
+			if(!(diff & 1)) {
+				continue;
+			}
+			Phys_Switch s;
+			this->_logical_to_physical(&s, ((byte_addr % MATRIX_ROW_BYTES) << 3) + bit_location, byte_addr / MATRIX_ROW_BYTES);
+			Xps::Xps_Op *op = &ops[num_ops++];
+			op->x = s.x;
+			op->y = s.y;
+			op->cs_number = s.chip;
+			op->state = state;
+			if(num_ops >= MAX_BATCH_OPS) {
+				Xps_driver.modify_batch(ops, num_ops);
+				changed += num_ops;
+				num_ops = 0;
+			}
+			/* Update the physical state */
+			if(state) {
+				this->_matrix_state[byte_addr] |= (1 << bit_location);
+			}
+			else {
+				this->_matrix_state[byte_addr] &= ~(1 << bit_location);
+			}
+		}
+	}
 
-	this->_logical_to_physical(&s, x, y);
+	if(num_ops) {
+		Xps_driver.modify_batch(ops, num_ops);
+		changed += num_ops;
+	}
+	return changed;
+}
 
-	Xps_driver.modify(s.x, s.y, s.chip, true);
+/*
+ * Change the desired state of a crosspoint switch.
+ *
+ * The physical switch is changed when the outermost batch is committed.
+ */
 
-	state_bits = state_bits | (1 << bit_location);
+void XPS_Logical::_set_switch(uint32_t x, uint32_t y, bool state) {
+	if((x >= this->get_num_x()) || (y > LOGICAL_MAX_Y)) {
+		POST_ERROR(Err_Handler::EH_IVXY);
+	}
 
+	uint16_t byte_addr = (x >> 3) + (y * MATRIX_ROW_BYTES);
+	uint8_t bit_location = x & 7;
 
-	this->_matrix_state[byte_addr] = state_bits;
-	osMutexRelease(this->_lock); /* Release the lock */
+	this->begin();
+	if(state) {
+		this->_desired_state[byte_addr] |= (1 << bit_location);
+	}
+	else {
+		this->_desired_state[byte_addr] &= ~(1 << bit_location);
+	}
+	this->commit();
+}
 
+/*
+ * Close a crosspoint switch
+ */
+
+void XPS_Logical::close_switch(uint32_t x, uint32_t y) {
+	this->_set_switch(x, y, true);
 }
 
 /*
@@ -157,22 +237,40 @@ void XPS_Logical::close_switch(uint32_t x, uint32_t y) {
  */
 
 void XPS_Logical::open_switch(uint32_t x, uint32_t y) {
-	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
-	uint16_t byte_addr = (x >> 3)+(y << 2);
-	uint8_t bit_location = x & 7;
-	uint8_t state_bits = this->_matrix_state[byte_addr];
-	Phys_Switch s;
-
-	this->_logical_to_physical(&s, x, y);
+	this->_set_switch(x, y, false);
+}
 
-	Xps_driver.modify(s.x, s.y, s.chip, false);
+/*
+ * Start a batch of switch changes.
+ *
+ * The lock is held until the matching commit(). Batches may be nested.
+ * Switch changes only update the desired state matrix until the outermost batch is committed.
+ */
 
-	state_bits = state_bits & ~(1 << bit_location);
+void XPS_Logical::begin(void) {
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+	this->_batch_depth++;
+}
 
+/*
+ * Commit a batch of switch changes.
+ *
+ * Only the switches whose desired state differs from their physical state are changed,
+ * so a switch opened then closed again in the same batch is not touched.
+ * All the switches are opened before any are closed (break before make), so two audio
+ * paths are never joined while a connection is rearranged.
+ */
 
-	this->_matrix_state[byte_addr] = state_bits;
+void XPS_Logical::commit(void) {
+	if(!this->_batch_depth) {
+		POST_ERROR(Err_Handler::EH_UHC);
+	}
+	this->_batch_depth--;
+	if(!this->_batch_depth) {
+		this->_apply_changes(false);
+		this->_apply_changes(true);
+	}
 	osMutexRelease(this->_lock); /* Release the lock */
-
 }
 
 
@@ -185,7 +283,7 @@ bool XPS_Logical::get_switch_state(uint32_t x, uint32_t y) {
 		POST_ERROR(Err_Handler::EH_IVXY);
 	}
 
-	uint16_t byte_addr = (x >> 3)+(y << 2);
+	uint16_t byte_addr = (x >> 3) + (y * MATRIX_ROW_BYTES);
 	uint8_t bit_location = x & 7;
 	uint8_t state_bits = this->_matrix_state[byte_addr];
 
@@ -203,9 +301,10 @@ bool XPS_Logical::get_switch_state(uint32_t x, uint32_t y) {
 
 void XPS_Logical::clear() {
 	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
-	/* Initialize state matrix */
+	/* Initialize state matrices */
 	for(uint32_t i = 0; i < sizeof(this->_matrix_state); i++) {
 		_matrix_state[i] = 0;
+		_desired_state[i] = 0;
 	}
 
 	/* Clear all connections in the crosspoint chips */
@@ -231,10 +330,13 @@ void XPS_Logical::init(void) {
 		0U
 	};
 
-	/* Initialize state matrix */
+	/* Initialize state matrices */
 	for(uint32_t i = 0; i < sizeof(this->_matrix_state); i++) {
 		_matrix_state[i] = 0;
+		_desired_state[i] = 0;
 	}
+	this->_batch_depth = 0;
+	this->_geometry = DEFAULT_FABRIC_GEOMETRY;
 
 	/* Clear all connections in the crosspoint chips */
 	Xps_driver.clear();
@@ -250,45 +352,140 @@ void XPS_Logical::init(void) {
 }
 
 
+/*
+ * Return the number of X columns on the fitted chips
+ */
+
+uint32_t XPS_Logical::get_num_x(void) {
+	return this->_geometry.num_chips * PHYSICAL_NUM_X;
+}
+
+/*
+ * Parse one key from the fabric section into a geometry.
+ *
+ * Returns false if the key or its value is invalid.
+ */
+
+bool XPS_Logical::parse_fabric_key(Fabric_Geometry *geometry, const char *key, const char *value) {
+	unsigned number;
+
+	if((!geometry) || (!key) || (!value)) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	if(!Utility.parse_unsigned(value, number)) {
+		return false;
+	}
+
+	if(!strcmp(key, "chips")) {
+		if((number < 1) || (number > Xps::MAX_CPS_CHIPS)) {
+			return false;
+		}
+		geometry->num_chips = (uint8_t) number;
+		return true;
+	}
+
+	if(!strcmp(key, "stages")) {
+		/* The junctors are the only stage the hardware has */
+		return (number == 1);
+	}
+
+	for(uint32_t group = 0; group < NUM_FABRIC_COLUMN_GROUPS; group++) {
+		if(!strcmp(key, column_usage[group].keyword)) {
+			if(number > LOGICAL_MAX_X) {
+				return false;
+			}
+			geometry->column_start[group] = (uint8_t) number;
+			return true;
+		}
+	}
+
+	return false; /* Unknown key */
+}
+
+/*
+ * Check that every column group fits on the fitted chips, and that no two groups share a column.
+ *
+ * Returns NULL if the geometry is usable, else a description of the problem.
+ */
+
+const char *XPS_Logical::check_geometry(const Fabric_Geometry *geometry) {
+	uint64_t used_columns = 0;
+
+	if(!geometry) {
+		POST_ERROR(Err_Handler::EH_NPFA);
+	}
+
+	for(uint32_t group = 0; group < NUM_FABRIC_COLUMN_GROUPS; group++) {
+		for(uint32_t index = 0; index < column_usage[group].count; index++) {
+			uint32_t x = geometry->column_start[group] + (index * column_usage[group].stride);
+			if(x >= (uint32_t) (geometry->num_chips * PHYSICAL_NUM_X)) {
+				return "Fabric column group does not fit on the chips fitted";
+			}
+			if(used_columns & (1ULL << x)) {
+				return "Fabric column groups overlap";
+			}
+			used_columns |= (1ULL << x);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Set the fabric geometry from the configuration.
+ *
+ * The fabric section is optional, the default geometry matches the standard two chip switch card.
+ * The geometry is only read at boot, a reload can't move calls which are already up.
+ */
+
+void XPS_Logical::config(void) {
+	Fabric_Geometry geometry = DEFAULT_FABRIC_GEOMETRY;
+	Config_RW::Config_Section_Type *section = Config_rw.find_section("fabric");
+
+	if(section) {
+		for(Config_RW::Config_Node_Type *node = section->head; node; node = node->next) {
+			if(!this->parse_fabric_key(&geometry, node->key, node->value)) {
+				POST_ERROR(Err_Handler::EH_CFER); /* Should have been caught by the validator */
+			}
+		}
+	}
+
+	if(this->check_geometry(&geometry)) {
+		POST_ERROR(Err_Handler::EH_CFER);
+	}
+
+	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
+	this->_geometry = geometry;
+	osMutexRelease(this->_lock); /* Release the lock */
+
+	LOG_INFO(TAG, "Fabric has %u chip(s), %u columns and %u junctors", geometry.num_chips, (unsigned) this->get_num_x(), MAX_JUNCTORS);
+}
+
+
 /*
  * Seize an available junctor.
  *
  * If the optional requested_junctor_number is passed in, try to seize it, else use
- * the next available junctor.
+ * the next available junctor. A junctor reserved through the resource manager is only
+ * given to its owner.
  *
  * Initializes the junctor info.
  *
  * Returns false if no junctors are available, else the numeric value for the junctor.
  */
 
-bool XPS_Logical::seize(Junctor_Info *info, int32_t requested_junctor_number) {
+bool XPS_Logical::seize(Junctor_Info *info, int32_t requested_junctor_number, void *owner) {
 	int32_t descriptor = (int32_t) MAX_JUNCTORS;
 	bool res = true;
 
 	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
 
-	if(requested_junctor_number == -1) {
-		for(descriptor = 0; descriptor < (int32_t) MAX_JUNCTORS; descriptor++){
-			if((this->_busy_bits & (1 << descriptor)) == 0) {
-				this->_busy_bits |= (1 << descriptor);
-				break;
-			}
-		}
+	if((requested_junctor_number >= -1) && (requested_junctor_number < (int32_t) MAX_JUNCTORS)) {
+		/* The junctor busy bits are kept by the resource manager */
+		descriptor = Resource_mgr.allocate(Resource_Mgr::RT_JUNCTOR, requested_junctor_number, owner);
 	}
-	else { /* Test and seize a specific junctor */
-		if((requested_junctor_number >= 0) && (requested_junctor_number < (int32_t) MAX_JUNCTORS) &&
-				((this->_busy_bits & (1 << requested_junctor_number)) == 0)) {
-			this->_busy_bits |= (1 << requested_junctor_number);
-			descriptor = requested_junctor_number; /* Grant junctor */
-		}
-		else {
-			descriptor = (int32_t) MAX_JUNCTORS; /* Not available */
-		}
-	}
-
 
-
-	if(descriptor >= (int32_t) MAX_JUNCTORS) {
+	if((descriptor < 0) || (descriptor >= (int32_t) MAX_JUNCTORS)) {
 		info->junctor_descriptor = -1;
 		res = false;
 	}
@@ -318,16 +515,16 @@ void XPS_Logical::release(Junctor_Info *info) {
 
 	osMutexAcquire(this->_lock, osWaitForever); /* Get the lock */
 
-
-	/* Un-busy the channel */
-	this->_busy_bits &= ~(1 << info->junctor_descriptor);
-
+	int32_t descriptor = info->junctor_descriptor;
 
 	/* Indicate not active */
 	info->junctor_descriptor = -1;
 
 	osMutexRelease(this->_lock); /* Release the lock */
 
+	/* Un-busy the junctor. This may hand it straight to a waiter. */
+	Resource_mgr.release(Resource_Mgr::RT_JUNCTOR, descriptor);
+
 }
 
 /*
@@ -350,10 +547,12 @@ void XPS_Logical::connect_phone_orig(Junctor_Info *info, int32_t phone_line_num_
 		info->connections.orig_recv.resource = info->connections.orig_send.resource = RSRC_LINE;
 		info->connections.orig_recv.x = x;
 		info->connections.orig_recv.y = y;
+		this->begin();
 		this->close_switch(x, y);
 		info->connections.orig_send.x = x + 1;
 		info->connections.orig_send.y = y + 1;
 		this->close_switch(info->connections.orig_send.x, info->connections.orig_send.y);
+		this->commit();
 	}
 	else {
 		POST_ERROR(Err_Handler::EH_CNRC);
@@ -370,8 +569,10 @@ void XPS_Logical::disconnect_phone_orig(Junctor_Info *info) {
 	}
 
 	if((info->connections.orig_recv.resource == RSRC_LINE) && (info->connections.orig_send.resource == RSRC_LINE)) {
+		this->begin();
 		this->open_switch(info->connections.orig_recv.x, info->connections.orig_recv.y);
 		this->open_switch(info->connections.orig_send.x, info->connections.orig_send.y);
+		this->commit();
 		info->connections.orig_recv.resource = info->connections.orig_send.resource = RSRC_NONE;
 	}
 	else {
@@ -399,10 +600,12 @@ void XPS_Logical::connect_phone_term(Junctor_Info *info, int32_t phone_line_num_
 		info->connections.term_recv.resource = info->connections.term_send.resource = RSRC_LINE;
 		info->connections.term_recv.x = x;
 		info->connections.term_recv.y = y + 1;
+		this->begin();
 		this->close_switch(info->connections.term_recv.x, info->connections.term_recv.y);
 		info->connections.term_send.x = x + 1;
 		info->connections.term_send.y = y;
 		this->close_switch(info->connections.term_send.x, info->connections.term_send.y);
+		this->commit();
 
 	}
 	else {
@@ -423,8 +626,10 @@ void XPS_Logical::disconnect_phone_term(Junctor_Info *info) {
 	}
 
 	if((info->connections.term_recv.resource == RSRC_LINE) && (info->connections.term_send.resource == RSRC_LINE)) {
+		this->begin();
 		this->open_switch(info->connections.term_recv.x, info->connections.term_recv.y);
 		this->open_switch(info->connections.term_send.x, info->connections.term_send.y);
+		this->commit();
 		info->connections.term_recv.resource = info->connections.term_send.resource = RSRC_NONE;
 	}
 	else {
@@ -451,10 +656,12 @@ void XPS_Logical::connect_trunk_orig(Junctor_Info *info, int32_t trunk_num_orig)
 		info->connections.orig_recv.resource = info->connections.orig_send.resource = RSRC_TRUNK;
 		info->connections.orig_recv.x = x;
 		info->connections.orig_recv.y = y;
+		this->begin();
 		this->close_switch(x, y);
 		info->connections.orig_send.x = x + 1;
 		info->connections.orig_send.y = y + 1;
 		this->close_switch(info->connections.orig_send.x, info->connections.orig_send.y);
+		this->commit();
 	}
 	else {
 		POST_ERROR(Err_Handler::EH_CNRC);
@@ -472,8 +679,10 @@ void XPS_Logical::disconnect_trunk_orig(Junctor_Info *info) {
 	}
 
 	if((info->connections.orig_recv.resource == RSRC_TRUNK) && (info->connections.orig_send.resource == RSRC_TRUNK)) {
+		this->begin();
 		this->open_switch(info->connections.orig_recv.x, info->connections.orig_recv.y);
 		this->open_switch(info->connections.orig_send.x, info->connections.orig_send.y);
+		this->commit();
 		info->connections.orig_recv.resource = info->connections.orig_send.resource = RSRC_NONE;
 	}
 	else {
@@ -502,10 +711,12 @@ void XPS_Logical::connect_trunk_term(Junctor_Info *info, int32_t trunk_num_term)
 		info->connections.term_recv.resource = info->connections.term_send.resource = RSRC_TRUNK;
 		info->connections.term_recv.x = x;
 		info->connections.term_recv.y = y + 1;
+		this->begin();
 		this->close_switch(info->connections.term_recv.x, info->connections.term_recv.y);
 		info->connections.term_send.x = x + 1;
 		info->connections.term_send.y = y;
 		this->close_switch(info->connections.term_send.x, info->connections.term_send.y);
+		this->commit();
 
 	}
 	else {
@@ -525,8 +736,10 @@ void XPS_Logical::disconnect_trunk_term(Junctor_Info *info) {
 	}
 
 	if((info->connections.term_recv.resource == RSRC_TRUNK) && (info->connections.term_send.resource == RSRC_TRUNK)) {
+		this->begin();
 		this->open_switch(info->connections.term_recv.x, info->connections.term_recv.y);
 		this->open_switch(info->connections.term_send.x, info->connections.term_send.y);
+		this->commit();
 		info->connections.term_recv.resource = info->connections.term_send.resource = RSRC_NONE;
 	}
 	else {
@@ -697,6 +910,8 @@ void XPS_Logical::disconnect_all(Junctor_Info *info) {
 	if(!info) {
 		POST_ERROR(Err_Handler::EH_NPFA);
 	}
+	/* Open all the switches in one batch */
+	this->begin();
 	if(info->connections.orig_recv.resource == RSRC_LINE) {
 		this->disconnect_phone_orig(info);
 	}
@@ -718,6 +933,7 @@ void XPS_Logical::disconnect_all(Junctor_Info *info) {
 	if(info->connections.digit_receiver.resource == RSRC_DTMF_RCVR) {
 			this->disconnect_dtmf_receiver(info);
 		}
+	this->commit();
 }
 
 